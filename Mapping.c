@@ -4,6 +4,79 @@
 
 #include "Mapping.h"
 
+/*-----------------------------------------------------------------------------+
+|                                 ARENA                                        |
++-----------------------------------------------------------------------------*/
+/* Alignment of the arena allocations: that of the widest types used */
+typedef union
+{
+    long double ld;
+    unsigned long long ull;
+    void *p;
+
+} MaxAlign;
+
+Arena* createArena(size_t capacity)
+{
+    Arena *arena = malloc(sizeof(Arena));
+    unsigned char *base = malloc(capacity > 0 ? capacity : 1);
+    if(!arena || !base)
+    {
+        free(arena);
+        free(base);
+        return NULL;
+    }
+
+    arena->base = base;
+    arena->capacity = capacity;
+    arena->used = 0;
+
+    return arena;
+}
+
+
+
+void freeArena(Arena *arena)
+{
+    if(!arena) return;
+    free(arena->base);
+    free(arena);
+}
+
+
+
+size_t arenaSize(size_t size)
+{
+    size_t alignment = sizeof(MaxAlign);
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+
+
+void* arenaAlloc(Arena *arena, size_t size)
+{
+    if(!arena)
+        return malloc(size);
+
+    size_t rounded = arenaSize(size);
+    if(rounded < size || rounded > arena->capacity - arena->used)
+        return NULL;
+
+    void *pointer = arena->base + arena->used;
+    arena->used += rounded;
+    return pointer;
+}
+
+
+
+void arenaFree(Arena *arena, void *pointer)
+{
+    if(!arena)
+        free(pointer);
+}
+
+
+
 /*-----------------------------------------------------------------------------+
 |                               HISTOGRAM                                      |
 +-----------------------------------------------------------------------------*/
@@ -34,6 +107,104 @@ void freeHistogram(Histogram* hist){
 
 
 
+/*-----------------------------------------------------------------------------+
+|                          CUMULATIVE HISTOGRAM                                |
++-----------------------------------------------------------------------------*/
+CumulativeHistogram* createCumulativeHistogram(const Histogram *histogram)
+{
+    return createMetricCumulativeHistogram(histogram, NULL);
+}
+
+
+
+CumulativeHistogram* createMetricCumulativeHistogram(const Histogram *histogram,
+                                                     const ErrorMetric *metric)
+{
+    return createCumulativeHistogramInArena(NULL, histogram, metric);
+}
+
+
+
+CumulativeHistogram* createCumulativeHistogramInArena(
+    Arena *arena, const Histogram *histogram, const ErrorMetric *metric)
+{
+    if(!histogram)
+        return NULL;
+
+    size_t n = histogram->length;
+    const double *weights = metric ? metric->weights : NULL;
+    if(weights && metric->length < n)
+        return NULL;
+
+    CumulativeHistogram *cumulative = arenaAlloc(arena,
+                                                 sizeof(CumulativeHistogram));
+    unsigned long long *count = arenaAlloc(arena, (n+1)
+                                           * sizeof(unsigned long long));
+    long double *sum = arenaAlloc(arena, (n+1) * sizeof(long double));
+    long double *sumSquares = arenaAlloc(arena, (n+1) * sizeof(long double));
+    long double *weight = weights
+        ? arenaAlloc(arena, (n+1) * sizeof(long double)) : NULL;
+    if(!cumulative || !count || !sum || !sumSquares || (weights && !weight))
+    {
+        arenaFree(arena, cumulative);
+        arenaFree(arena, count);
+        arenaFree(arena, sum);
+        arenaFree(arena, sumSquares);
+        arenaFree(arena, weight);
+        return NULL;
+    }
+
+    count[0] = 0;
+    sum[0] = sumSquares[0] = 0;
+    if(weight)
+        weight[0] = 0;
+    for(size_t i=0; i<n; i++)
+    {
+        long double c = histogram->count[i];
+        if(weights)
+        {
+            c *= weights[i];
+            weight[i+1] = weight[i] + c;
+        }
+        count[i+1] = count[i] + histogram->count[i];
+        sum[i+1] = sum[i] + c * i;
+        sumSquares[i+1] = sumSquares[i] + c * i * i;
+    }
+
+    cumulative->length = n;
+    cumulative->count = count;
+    cumulative->sum = sum;
+    cumulative->sumSquares = sumSquares;
+    cumulative->norm = metric ? metric->norm : NORM_L2;
+    cumulative->weight = weight;
+    cumulative->values = NULL;
+
+    return cumulative;
+}
+
+
+
+void freeCumulativeHistogram(CumulativeHistogram *cumulative)
+{
+    freeCumulativeHistogramInArena(NULL, cumulative);
+}
+
+
+
+void freeCumulativeHistogramInArena(Arena *arena,
+                                    CumulativeHistogram *cumulative)
+{
+    if(!cumulative) return;
+    arenaFree(arena, cumulative->count);
+    arenaFree(arena, cumulative->sum);
+    arenaFree(arena, cumulative->sumSquares);
+    arenaFree(arena, cumulative->weight);
+    arenaFree(arena, cumulative->values);
+    arenaFree(arena, cumulative);
+}
+
+
+
 /*-----------------------------------------------------------------------------+
 |                                MAPPING                                       |
 +-----------------------------------------------------------------------------*/
@@ -68,26 +239,107 @@ void freeMapping(Mapping *mapping)
 }
 
 
-uint16_t* mapping2Lookup(const Mapping *mapping, uint16_t maxValue)
+Mapping* createMappingFromBoundaries(const CumulativeHistogram *cumulative,
+                                     const size_t *boundaries, size_t k,
+                                     size_t nLevels)
 {
-    if(!mapping)
+    return createMappingFromBoundariesInArena(NULL, cumulative, boundaries,
+                                              k, nLevels);
+}
+
+
+Mapping* createMappingFromBoundariesInArena(Arena *arena,
+                                            const CumulativeHistogram *cumulative,
+                                            const size_t *boundaries, size_t k,
+                                            size_t nLevels)
+{
+    if(!cumulative || k == 0 || k > nLevels || (k > 1 && !boundaries))
         return NULL;
 
-    uint16_t* lookUpTable = calloc((maxValue+1), sizeof(uint16_t));
-    if(!lookUpTable)
+    Mapping *mapping;
+    if(arena)
+    {
+        mapping = arenaAlloc(arena, sizeof(Mapping));
+        size_t *thresholds = arenaAlloc(arena, nLevels * sizeof(size_t));
+        uint16_t *levels = arenaAlloc(arena, nLevels * sizeof(uint16_t));
+        if(!mapping || !thresholds || !levels)
+            return NULL;
+        *mapping = (Mapping){nLevels, thresholds, levels};
+    }
+    else
+        mapping = createUninitializedMapping(nLevels);
+    if(!mapping)
         return NULL;
 
+    size_t begin = 0;
+    for(size_t i=0; i<nLevels; i++)
+    {
+        size_t end = i+1 < k ? boundaries[i] : cumulative->length;
+        if(i < k)
+            intervalError(cumulative, begin, end, &mapping->levels[i]);
+        else
+            mapping->levels[i] = mapping->levels[k-1];
+        mapping->thresholds[i] = end;
+        begin = end;
+    }
+
+    return mapping;
+}
+
+
+int mapping2LookupBuffer(const Mapping *mapping, uint16_t maxValue,
+                         uint16_t *lookUpTable)
+{
+    if(!mapping || !lookUpTable || mapping->nLevels == 0)
+        return -1;
+
     size_t k = 0;
     for(size_t i=0; i<(size_t)(maxValue+1); i++)
     {
-        if(mapping->thresholds[k] == i)
+        if(mapping->thresholds[k] == i && k+1 < mapping->nLevels)
             k++;
         lookUpTable[i] = mapping->levels[k];
     }
 
-    return lookUpTable;
+    return 0;
+}
+
+
+int mapping2IndexBuffer(const Mapping *mapping, uint16_t maxValue,
+                        uint8_t *indexTable)
+{
+    if(!mapping || !indexTable || mapping->nLevels == 0
+       || mapping->nLevels > UINT8_MAX+1)
+        return -1;
+
+    size_t k = 0;
+    for(size_t i=0; i<(size_t)(maxValue+1); i++)
+    {
+        if(mapping->thresholds[k] == i && k+1 < mapping->nLevels)
+            k++;
+        indexTable[i] = (uint8_t)k;
+    }
+
+    return 0;
+}
+
+
+uint16_t* mapping2Lookup(const Mapping *mapping, uint16_t maxValue)
+{
+    if(!mapping)
+        return NULL;
+
+    uint16_t* lookUpTable = calloc((maxValue+1), sizeof(uint16_t));
+    if(!lookUpTable)
+        return NULL;
 
+    if(mapping2LookupBuffer(mapping, maxValue, lookUpTable) != 0)
+    {
+        free(lookUpTable);
+        return NULL;
+    }
 
+    return lookUpTable;
 }
 
 
@@ -115,3 +367,47 @@ double computeError(const Mapping *mapping, const Histogram *originalHistogram)
 
 
 }
+
+
+
+double computeMetricError(const Mapping *mapping,
+                          const Histogram *originalHistogram,
+                          const ErrorMetric *metric)
+{
+    if(!mapping || !originalHistogram)
+        return DBL_MAX;
+
+    uint16_t *lookUpTable = mapping2Lookup(mapping, originalHistogram->length-1);
+    if(!lookUpTable)
+        return DBL_MAX;
+
+    double err = lookupError(lookUpTable, originalHistogram, metric);
+    free(lookUpTable);
+    return err;
+}
+
+
+
+double lookupError(const uint16_t *lookUpTable,
+                   const Histogram *originalHistogram,
+                   const ErrorMetric *metric)
+{
+    if(!lookUpTable || !originalHistogram)
+        return DBL_MAX;
+
+    const double *weights = metric ? metric->weights : NULL;
+    if(weights && metric->length < originalHistogram->length)
+        return DBL_MAX;
+
+    double err = 0, delta;
+    for(size_t i=0; i<originalHistogram->length; i++)
+    {
+        delta = fabs((double)i - lookUpTable[i]);
+        if(!metric || metric->norm == NORM_L2)
+            delta *= delta;
+        err += originalHistogram->count[i] * delta
+             * (weights ? weights[i] : 1.);
+    }
+
+    return err;
+}
@@ -1,13 +1,90 @@
 /***********************************************************************
  * Data structures and utils for compression
+ * - Arena
  * - Histogram
+ * - Error metric (weighted L2 or L1)
+ * - Cumulative histogram (prefix sums, O(1) or O(log n) interval errors)
  * - Mapping
  ***********************************************************************/
 
 #ifndef _MAPPING_H_
 #define _MAPPING_H_
 
+#include <stddef.h>
 #include <stdint.h>
+#include <math.h>
+
+/*-----------------------------------------------------------------------------+
+|                                 ARENA                                        |
++-----------------------------------------------------------------------------*/
+/*
+ * Bump allocator over a buffer allocated once (see `createArena`). The
+ * functions taking an `Arena*` allocate from it, or from the heap when it
+ * is NULL; memory is given back to an arena all at once by resetting
+ * `used` (to 0, or to a value saved before some temporary allocations).
+ */
+typedef struct
+{
+    unsigned char *base;            // The buffer
+    size_t capacity;                // Its size, in bytes
+    size_t used;                    // Bytes allocated so far
+
+} Arena;
+
+
+/***********************************************************************
+ * Create an arena of the given capacity.
+ *
+ * PARAMETERS
+ * capacity     The size of the arena, in bytes
+ *
+ * RETURN
+ * arena        A pointer to an Arena. It must be deleted by calling
+ *              `freeArena`
+ * NULL         In case of error
+ ***********************************************************************/
+Arena* createArena(size_t capacity);
+
+
+/***********************************************************************
+ * Free the memory allocated by this arena
+ *
+ * PAREMETERS
+ * arena        A pointer to an Arena
+ ***********************************************************************/
+void freeArena(Arena *arena);
+
+
+/***********************************************************************
+ * Allocate `size` bytes, suitably aligned for any type used here.
+ *
+ * PARAMETERS
+ * arena        A pointer to an Arena, NULL to allocate on the heap
+ * size         The number of bytes
+ *
+ * RETURN
+ * pointer      The memory, to be given back with `arenaFree`
+ * NULL         In case of error (or if the arena is full)
+ ***********************************************************************/
+void* arenaAlloc(Arena *arena, size_t size);
+
+
+/***********************************************************************
+ * Give back memory from `arenaAlloc`: `free` if `arena` is NULL, nothing
+ * otherwise (see `Arena`).
+ *
+ * PAREMETERS
+ * arena        The Arena the memory comes from, or NULL
+ * pointer      The memory
+ ***********************************************************************/
+void arenaFree(Arena *arena, void *pointer);
+
+
+/***********************************************************************
+ * Number of bytes taken in an arena by an allocation of `size` bytes.
+ ***********************************************************************/
+size_t arenaSize(size_t size);
+
 
 /*-----------------------------------------------------------------------------+
 |                               HISTOGRAM                                      |
@@ -43,6 +120,209 @@ Histogram* createEmptyHistogram(size_t length);
 void freeHistogram(Histogram* hist);
 
 
+/*-----------------------------------------------------------------------------+
+|                              ERROR METRIC                                    |
++-----------------------------------------------------------------------------*/
+typedef enum
+{
+    NORM_L2,                        // Squared error, best level: mean
+    NORM_L1                         // Absolute error, best level: median
+
+} Norm;
+
+/*
+ * Error of representing value v by level g: w(v) * |v - g|^2 (NORM_L2) or
+ * w(v) * |v - g| (NORM_L1), where w(v) is the weight of the gray level v
+ * (e.g. its perceptual importance), 1 if `weights` is NULL.
+ */
+typedef struct
+{
+    Norm norm;
+    const double *weights;          // Weight of each gray level, or NULL
+    size_t length;                  // Number of weights
+
+} ErrorMetric;
+
+
+/*-----------------------------------------------------------------------------+
+|                          CUMULATIVE HISTOGRAM                                |
++-----------------------------------------------------------------------------*/
+/*
+ * Prefix sums of a histogram: entry i covers the values [0, i), so the
+ * arrays hold `length+1` entries. Sums are kept in long double, which
+ * represents them exactly up to 2^64 (e.g. 2^31 pixels of 16-bit values).
+ * With a weighted metric, `sum` and `sumSquares` are weighted as well.
+ */
+typedef struct
+{
+    size_t length;                  // Length of the histogram
+    unsigned long long *count;      // Number of pixels of value < i
+    long double *sum;               // Sum of the values < i
+    long double *sumSquares;        // Sum of the squares of the values < i
+    Norm norm;                      // Norm of the error
+    long double *weight;            // Sum of the weights of the pixels of
+                                    // value < i, NULL if not weighted
+    size_t *values;                 // Value of each bin, NULL if the bins
+                                    // are the values 0, ..., length-1
+
+} CumulativeHistogram;
+
+
+/***********************************************************************
+ * Compute the prefix sums of a histogram, in O(length).
+ *
+ * PARAMETERS
+ * histogram    A valid pointer to an Histogram
+ *
+ * RETURN
+ * cumulative   A pointer to a CumulativeHistogram. It must be deleted by
+ *              calling `freeCumulativeHistogram`
+ * NULL         In case of error
+ ***********************************************************************/
+CumulativeHistogram* createCumulativeHistogram(const Histogram *histogram);
+
+
+/***********************************************************************
+ * Same as `createCumulativeHistogram`, for the given error metric: the
+ * interval errors and levels of the result are those of the metric.
+ *
+ * PARAMETERS
+ * histogram    A valid pointer to an Histogram
+ * metric       The metric, NULL for the (unweighted) squared error
+ *
+ * RETURN
+ * cumulative   A pointer to a CumulativeHistogram. It must be deleted by
+ *              calling `freeCumulativeHistogram`
+ * NULL         In case of error (or less weights than gray levels)
+ ***********************************************************************/
+CumulativeHistogram* createMetricCumulativeHistogram(const Histogram *histogram,
+                                                     const ErrorMetric *metric);
+
+
+/***********************************************************************
+ * Same as `createMetricCumulativeHistogram`, allocated from an arena.
+ *
+ * PARAMETERS
+ * arena        A pointer to an Arena, NULL to allocate on the heap
+ * histogram    A valid pointer to an Histogram
+ * metric       The metric, NULL for the (unweighted) squared error
+ *
+ * RETURN
+ * cumulative   A pointer to a CumulativeHistogram. It must be deleted by
+ *              calling `freeCumulativeHistogramInArena` with `arena`
+ * NULL         In case of error
+ ***********************************************************************/
+CumulativeHistogram* createCumulativeHistogramInArena(
+    Arena *arena, const Histogram *histogram, const ErrorMetric *metric);
+
+
+/***********************************************************************
+ * Free the memory allocated by this cumulative histogram
+ *
+ * PAREMETERS
+ * cumulative   A pointer to a CumulativeHistogram
+ ***********************************************************************/
+void freeCumulativeHistogram(CumulativeHistogram *cumulative);
+
+
+/***********************************************************************
+ * Free a cumulative histogram allocated from an arena (see `arenaFree`)
+ *
+ * PAREMETERS
+ * arena        The arena it was allocated from, or NULL
+ * cumulative   A pointer to a CumulativeHistogram
+ ***********************************************************************/
+void freeCumulativeHistogramInArena(Arena *arena,
+                                    CumulativeHistogram *cumulative);
+
+
+/* Weight of the pixels of the bins < i */
+static inline long double prefixWeight(const CumulativeHistogram *cumulative,
+                                       size_t i)
+{
+    return cumulative->weight ? cumulative->weight[i]
+                              : (long double)cumulative->count[i];
+}
+
+/* Gray value of bin i */
+static inline size_t binValue(const CumulativeHistogram *cumulative, size_t i)
+{
+    return cumulative->values ? cumulative->values[i] : i;
+}
+
+/***********************************************************************
+ * Absolute error of representing the bins [begin, end) of weight `w`
+ * (> 0) by their weighted median, in O(log(end - begin)).
+ ***********************************************************************/
+static inline double intervalErrorL1(const CumulativeHistogram *cumulative,
+                                     size_t begin, size_t end, long double w,
+                                     uint16_t *level)
+{
+    // Median bin m: first bin such that the weight of [begin, m] reaches
+    // half of the weight of the interval
+    long double base = prefixWeight(cumulative, begin), half = w / 2;
+    size_t lo = begin + 1, hi = end;
+    while(lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if(prefixWeight(cumulative, mid) - base < half)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    size_t m = lo - 1;
+    long double g = binValue(cumulative, m);
+    if(level)
+        *level = (uint16_t)g;
+
+    // Bins below the median count g - v, the others v - g
+    long double below = prefixWeight(cumulative, m) - base;
+    long double above = prefixWeight(cumulative, end)
+                      - prefixWeight(cumulative, m);
+    long double sBelow = cumulative->sum[m] - cumulative->sum[begin];
+    long double sAbove = cumulative->sum[end] - cumulative->sum[m];
+    return (double)(g * below - sBelow + sAbove - g * above);
+}
+
+/***********************************************************************
+ * Error of representing the values [begin, end) by their best integer
+ * level, in O(1) for NORM_L2 (the rounded weighted mean) and O(log n)
+ * for NORM_L1 (the weighted median).
+ *
+ * PARAMETERS
+ * cumulative   A valid pointer to a CumulativeHistogram
+ * begin, end   The interval, with begin < end <= length
+ * level        If not NULL, receives the best level (the middle of the
+ *              interval if it is empty)
+ *
+ * RETURN
+ * error        The error of the interval
+ ***********************************************************************/
+static inline double intervalError(const CumulativeHistogram *cumulative,
+                                   size_t begin, size_t end, uint16_t *level)
+{
+    long double n = prefixWeight(cumulative, end)
+                  - prefixWeight(cumulative, begin);
+    if(n <= 0)
+    {
+        if(level)
+            *level = (uint16_t)binValue(cumulative, (begin + end - 1) / 2);
+        return 0.;
+    }
+
+    if(cumulative->norm == NORM_L1)
+        return intervalErrorL1(cumulative, begin, end, n, level);
+
+    long double s1 = cumulative->sum[end] - cumulative->sum[begin];
+    long double s2 = cumulative->sumSquares[end]
+                   - cumulative->sumSquares[begin];
+    long double g = floorl(s1 / n + 0.5L);
+    if(level)
+        *level = (uint16_t)g;
+    return (double)(s2 - 2 * g * s1 + g * g * n);
+}
+
+
 /*-----------------------------------------------------------------------------+
 |                                MAPPING                                       |
 +-----------------------------------------------------------------------------*/
@@ -78,6 +358,49 @@ Mapping* createUninitializedMapping(size_t nLevels);
 void freeMapping(Mapping *mapping);
 
 
+/*************************************************************************
+ * Create the mapping whose intervals are [0, p_1), [p_1, p_2), ...,
+ * [p_{k-1}, length), each represented by its best level (see
+ * `intervalError`). If `nLevels > k`, the last level is repeated.
+ *
+ * PARAMETERS
+ * cumulative   A valid pointer to a CumulativeHistogram
+ * boundaries   The k-1 increasing boundaries p_1, ..., p_{k-1}
+ * k            The number of intervals
+ * nLevels      The number of levels of the mapping (>= k)
+ *
+ * RETURN
+ * mapping     A pointer to a Mapping. It must be deleted by calling
+ *             `freeMapping`
+ * NULL        In case of error
+ *************************************************************************/
+Mapping* createMappingFromBoundaries(const CumulativeHistogram *cumulative,
+                                     const size_t *boundaries, size_t k,
+                                     size_t nLevels);
+
+
+/*************************************************************************
+ * Same as `createMappingFromBoundaries`, allocated from an arena: the
+ * mapping then lives as long as the memory of the arena and must NOT be
+ * deleted with `freeMapping` (it must be if `arena` is NULL).
+ *
+ * PARAMETERS
+ * arena        A pointer to an Arena, NULL to allocate on the heap
+ * cumulative   A valid pointer to a CumulativeHistogram
+ * boundaries   The k-1 increasing boundaries p_1, ..., p_{k-1}
+ * k            The number of intervals
+ * nLevels      The number of levels of the mapping (>= k)
+ *
+ * RETURN
+ * mapping     A pointer to a Mapping
+ * NULL        In case of error
+ *************************************************************************/
+Mapping* createMappingFromBoundariesInArena(Arena *arena,
+                                            const CumulativeHistogram *cumulative,
+                                            const size_t *boundaries, size_t k,
+                                            size_t nLevels);
+
+
 /*************************************************************************
  * Compute the lookup table associated with the mapping
  * The compressed images must be free with `freeImage`.
@@ -93,6 +416,42 @@ void freeMapping(Mapping *mapping);
 uint16_t* mapping2Lookup(const Mapping *mapping, uint16_t maxValue);
 
 
+/*************************************************************************
+ * Same as `mapping2Lookup` but fills a lookup table provided by the
+ * caller instead of allocating one.
+ *
+ * PARAMETERS
+ * mapping      A valid pointer to a Mapping
+ * maxValue     The maximum value an image on which the mapping will be
+ *              used can take
+ * lookUpTable  A buffer of at least `maxValue+1` entries
+ *
+ * RETURN
+ * 0            If no error
+ * non-0        Otherwise
+ *************************************************************************/
+int mapping2LookupBuffer(const Mapping *mapping, uint16_t maxValue,
+                         uint16_t *lookUpTable);
+
+
+/*************************************************************************
+ * Fill a table giving, for each gray value, the index of its level in
+ * the mapping (i.e. `lookUpTable[v] == mapping->levels[indexTable[v]]`).
+ *
+ * PARAMETERS
+ * mapping      A valid pointer to a Mapping with at most 256 levels
+ * maxValue     The maximum value an image on which the mapping will be
+ *              used can take
+ * indexTable   A buffer of at least `maxValue+1` entries
+ *
+ * RETURN
+ * 0            If no error
+ * non-0        Otherwise
+ *************************************************************************/
+int mapping2IndexBuffer(const Mapping *mapping, uint16_t maxValue,
+                        uint8_t *indexTable);
+
+
 /*************************************************************************
  * Compute the error of using the given Mapping on the given Histogram.
  *
@@ -107,6 +466,41 @@ uint16_t* mapping2Lookup(const Mapping *mapping, uint16_t maxValue);
 double computeError(const Mapping *mapping, const Histogram *originalHistogram);
 
 
+/*************************************************************************
+ * Same as `computeError` for the given error metric.
+ *
+ * PARAMETERS
+ * mapping            A valid pointer to a Mapping
+ * originalHistogram  A valid pointer to an Histogram
+ * metric             The metric, NULL for the squared error
+ *
+ * RETURN
+ * error              The error associated to the compression or DBL_MAX
+ *                    in case of error.
+ *************************************************************************/
+double computeMetricError(const Mapping *mapping,
+                          const Histogram *originalHistogram,
+                          const ErrorMetric *metric);
+
+
+/*************************************************************************
+ * Same as `computeMetricError` from the lookup table of the mapping (see
+ * `mapping2LookupBuffer`), without allocating anything.
+ *
+ * PARAMETERS
+ * lookUpTable        A lookup table of `originalHistogram->length` entries
+ * originalHistogram  A valid pointer to an Histogram
+ * metric             The metric, NULL for the squared error
+ *
+ * RETURN
+ * error              The error associated to the compression or DBL_MAX
+ *                    in case of error.
+ *************************************************************************/
+double lookupError(const uint16_t *lookUpTable,
+                   const Histogram *originalHistogram,
+                   const ErrorMetric *metric);
+
+
 
 
 
@@ -6,97 +6,215 @@
 
 #include "PGM.h"
 
-PGM* createImageFromFile(const char* filename)
+/*
+ * Raster decoding/encoding, generated for both sample sizes.
+ * Binary rasters are transferred one row at a time; 16-bit samples are
+ * stored most significant byte first in the file.
+ */
+static inline void swapRow8(uint8_t* row, size_t length)
 {
-  FILE* file = fopen(filename, "r");
-  if(!file)
-    return NULL;
+  (void)row;
+  (void)length;
+}
+
+static inline void swapRow16(uint16_t* row, size_t length)
+{
+  for (size_t j = 0; j < length; ++j)
+  {
+    const unsigned char* bytes = (const unsigned char*)&row[j];
+    row[j] = (uint16_t)((bytes[0] << 8) | bytes[1]);
+  }
+}
+
+#define DEFINE_READ_RASTER(NAME, TYPE, ROWS, SWAP)                          \
+static int NAME(FILE* file, PGM* image, int binary)                          \
+{                                                                            \
+  size_t length = image->width * image->channels;                            \
+  for (size_t i = 0; i < image->height; ++i)                                 \
+  {                                                                          \
+    TYPE* row = image->ROWS[i];                                              \
+    if (binary)                                                              \
+    {                                                                        \
+      if (fread(row, sizeof(TYPE), length, file) != length)                  \
+        return -1;                                                           \
+      SWAP(row, length);                                                     \
+      continue;                                                              \
+    }                                                                        \
+    for (size_t j = 0; j < length; ++j)                                      \
+    {                                                                        \
+      int value = -1;                                                        \
+      if (fscanf(file, "%d", &value) != 1 || value < 0                       \
+          || value > image->maxValue)                                        \
+        return -1;                                                           \
+      row[j] = (TYPE)value;                                                  \
+    }                                                                        \
+  }                                                                          \
+  return 0;                                                                  \
+}
+
+#define DEFINE_WRITE_RASTER(NAME, TYPE, ROWS, SWAP)                         \
+static int NAME(FILE* file, const PGM* image, int binary)                    \
+{                                                                            \
+  size_t length = image->width * image->channels;                            \
+  TYPE* buffer = binary ? malloc(length * sizeof(TYPE) + 1) : NULL;          \
+  if (binary && buffer == NULL)                                              \
+    return -1;                                                               \
+  int status = 0;                                                            \
+  for (size_t i = 0; i < image->height && status == 0; ++i)                  \
+  {                                                                          \
+    const TYPE* row = image->ROWS[i];                                        \
+    if (binary)                                                              \
+    {                                                                        \
+      memcpy(buffer, row, length * sizeof(TYPE));                            \
+      SWAP(buffer, length);                                                  \
+      if (fwrite(buffer, sizeof(TYPE), length, file) != length)              \
+        status = -1;                                                         \
+      continue;                                                              \
+    }                                                                        \
+    for (size_t j = 0; j < length; ++j)                                      \
+      fprintf(file, "%u ", (unsigned)row[j]);                                \
+    fprintf(file, "\n");                                                     \
+  }                                                                          \
+  free(buffer);                                                              \
+  return status;                                                             \
+}
+
+DEFINE_READ_RASTER(readRaster8, uint8_t, array8, swapRow8)
+DEFINE_READ_RASTER(readRaster16, uint16_t, array, swapRow16)
+DEFINE_WRITE_RASTER(writeRaster8, uint8_t, array8, swapRow8)
+DEFINE_WRITE_RASTER(writeRaster16, uint16_t, array, swapRow16)
+
+int readImageHeader(FILE* file, PGMHeader* header)
+{
+  if (file == NULL || header == NULL)
+    return -1;
 
   // File encoding
   char magicNumber[3];
   if (fscanf(file, "%2s", magicNumber) != 1)
-  {
-    fclose(file);
-    return NULL;
-  }
+    return -1;
 
   PGMType type;
   if (strcmp(magicNumber, "P2") == 0)
     type = ASCII;
   else if (strcmp(magicNumber, "P5") == 0)
     type = BINARY;
+  else if (strcmp(magicNumber, "P3") == 0)
+    type = PPM_ASCII;
+  else if (strcmp(magicNumber, "P6") == 0)
+    type = PPM_BINARY;
   else
-  {
-    fclose(file);
-    return NULL;
-  }
+    return -1;
 
   // Skip comments
-  char nextChar = fgetc(file);
+  int nextChar = fgetc(file);
   while (nextChar != EOF && !isdigit(nextChar))
     nextChar = fgetc(file);
-  fseek(file, -1, SEEK_CUR);
+  ungetc(nextChar, file);
 
   // read width
   size_t width = 0;
   if (fscanf(file, "%lu", &width) != 1)
-  {
-    fclose(file);
-    return NULL;
-  }
+    return -1;
 
   // read height
   size_t height = 0;
   if (fscanf(file, "%lu", &height) != 1)
-  {
-    fclose(file);
-    return NULL;
-  }
+    return -1;
 
   // read max value
   uint16_t maxValue = 0;
   if (fscanf(file, "%" SCNu16, &maxValue) != 1)
-  {
-    fclose(file);
+    return -1;
+
+  // skip space in binary format
+  int binary = type == BINARY || type == PPM_BINARY;
+  if (binary)
+    fgetc(file);
+
+  header->type = type;
+  header->width = width;
+  header->height = height;
+  header->channels = (type == PPM_ASCII || type == PPM_BINARY) ? 3 : 1;
+  header->maxValue = maxValue;
+  header->bytesPerSample = maxValue <= UINT8_MAX ? 1 : 2;
+  header->rasterOffset = binary ? ftell(file) : -1;
+  return 0;
+}
+
+int probeImage(const char* filename, PGMHeader* header)
+{
+  FILE* file = filename ? fopen(filename, "r") : NULL;
+  if (file == NULL)
+    return -1;
+
+  int status = readImageHeader(file, header);
+  fclose(file);
+  return status;
+}
+
+int endOfImages(FILE* file)
+{
+  int nextChar = fgetc(file);
+  while (nextChar != EOF && isspace(nextChar))
+    nextChar = fgetc(file);
+  if (nextChar == EOF)
+    return 1;
+  ungetc(nextChar, file);
+  return 0;
+}
+
+PGM* readImage(FILE* file)
+{
+  PGMHeader header;
+  if (readImageHeader(file, &header) != 0)
     return NULL;
-  }
 
   // create image
-  PGM* res = createEmptyImage(width, height, maxValue);
+  PGM* res = createEmptyMultiChannelImage(header.width, header.height,
+                                          header.channels, header.maxValue);
   if (res == NULL)
+    return NULL;
+  res->type = header.type;
+
+  // fill image (color samples are interleaved: R, G, B, R, G, B, ...)
+  int binary = res->type == BINARY || res->type == PPM_BINARY;
+  int status = res->bytesPerSample == 1 ? readRaster8(file, res, binary)
+                                        : readRaster16(file, res, binary);
+  if (status != 0)
   {
-    fclose(file);
+    freeImage(res);
     return NULL;
   }
-  res->type = type;
 
-  // skip space in binary format
-  if (res->type == BINARY)
-    fgetc(file);
+  return res;
+}
 
-  // fill image
-  for (size_t i = 0; i < res->height; ++i)
-    for (size_t j = 0; j < res->width; ++j)
-    {
-      int value = -1;
-      if (res->type == BINARY)
-        value = fgetc(file);
-      else
-        fscanf(file, "%d", &value);
-
-      if (value < 0)
-      {
-        freeImage(res);
-        fclose(file);
-        return NULL;
-      }
-      res->array[i][j] = (uint16_t)value;
-    }
+PGM* createImageFromFile(const char* filename)
+{
+  FILE* file = fopen(filename, "r");
+  if(!file)
+    return NULL;
 
+  PGM* res = readImage(file);
   fclose(file);
   return res;
 }
 
+int writeImage(FILE* file, const PGM* image)
+{
+  if (file == NULL || image == NULL)
+    return -1;
+
+  fprintf(file, "P%d\n", (int)image->type);
+  int binary = image->type == BINARY || image->type == PPM_BINARY;
+  fprintf(file, "%lu %lu\n", image->width, image->height);
+  fprintf(file, "%u\n", image->maxValue);
+
+  return image->bytesPerSample == 1 ? writeRaster8(file, image, binary)
+                                    : writeRaster16(file, image, binary);
+}
+
 int saveImageToFile(const PGM* image, const char* filename)
 {
   if (image == NULL)
@@ -108,63 +226,67 @@ int saveImageToFile(const PGM* image, const char* filename)
     return -1;
   }
 
-  fprintf(file, image->type == BINARY ? "P5\n" : "P2\n");
-  fprintf(file, "%lu %lu\n", image->width, image->height);
-  fprintf(file, "%u\n", image->maxValue);
-
-  for (size_t i = 0; i < image->height; ++i)
-  {
-    for (size_t j = 0; j < image->width; ++j)
-    {
-      if (image->type == BINARY)
-        image->maxValue > 256 ? fputc((uint16_t)image->array[i][j], file)
-                              : fputc((uint8_t)image->array[i][j], file);
-      else
-        fprintf(file, "%u ", image->array[i][j]);
-    }
-
-    if (image->type == ASCII)
-      fprintf(file, "\n");
-  }
+  int status = writeImage(file, image);
 
-  fclose(file);
-  return 0;
+  if (fclose(file) != 0)
+    status = -1;
+  return status;
 }
 
 PGM* createEmptyImage(size_t width, size_t height, size_t numLevels)
 {
+  return createEmptyMultiChannelImage(width, height, 1, numLevels);
+}
+
+PGM* createEmptyMultiChannelImage(size_t width, size_t height,
+                                  size_t channels, size_t numLevels)
+{
+  if (channels != 1 && channels != 3)
+    return NULL;
+
   PGM* res = malloc(sizeof(PGM));
   if (res == NULL)
     return NULL;
 
-  res->type = ASCII;
+  res->type = channels == 1 ? ASCII : PPM_ASCII;
+  res->channels = channels;
   res->width = width;
   res->height = height;
   res->maxValue = numLevels;
 
-  res->array = malloc(height * sizeof(uint16_t*));
-  if (res->array == NULL)
+  // Rows point into a single contiguous raster so that the image can also be
+  // seen as a strided pixel buffer (row i starts at
+  // raster + i * width * channels * bytesPerSample)
+  res->bytesPerSample = numLevels <= UINT8_MAX ? 1 : 2;
+  res->array = NULL;
+  res->array8 = NULL;
+
+  size_t rowLength = width * channels;
+  size_t numPixels = rowLength * height;
+  void* raster = calloc(numPixels > 0 ? numPixels : 1, res->bytesPerSample);
+  if (res->bytesPerSample == 1)
+    res->array8 = malloc(height * sizeof(uint8_t*));
+  else
+    res->array = malloc(height * sizeof(uint16_t*));
+
+  if ((res->array == NULL && res->array8 == NULL) || raster == NULL)
   {
+    free(raster);
+    free(res->array);
+    free(res->array8);
     free(res);
     return NULL;
   }
 
   for (size_t i = 0; i < height; ++i)
   {
-    res->array[i] = malloc(width * sizeof(uint16_t));
-    if (res->array[i] == NULL)
-    {
-      for (size_t j = 0; j < i; ++j)
-        free(res->array[j]);
-      free(res->array);
-      free(res);
-      return NULL;
-    }
-
-    for (size_t j = 0; j < width; ++j)
-      res->array[i][j] = 0;
+    if (res->bytesPerSample == 1)
+      res->array8[i] = (uint8_t*)raster + i * rowLength;
+    else
+      res->array[i] = (uint16_t*)raster + i * rowLength;
   }
 
+  res->raster = raster;
   return res;
 }
 
@@ -172,9 +294,9 @@ void freeImage(PGM* image)
 {
   if (image == NULL)
     return;
-  for (size_t i = 0; i < image->height; ++i)
-    free(image->array[i]);
+  free(image->raster);
   free(image->array);
+  free(image->array8);
   free(image);
   return;
 }
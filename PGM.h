@@ -3,6 +3,11 @@
  * PGM stands for Portable Gray Map.
  * File format specification: http://netpbm.sourceforge.net/doc/pgm.html
  *
+ * Color images (PPM, Portable Pixel Map, P3/P6) are supported with the
+ * same structure: each row then holds 'width x channels' interleaved
+ * samples (R, G, B, R, G, B, ...).
+ * File format specification: http://netpbm.sourceforge.net/doc/ppm.html
+ *
  * Note: if you have trouble with one of the type (ascii/binary) try the
  * other. There seems to be some portability issues.
  ***********************************************************************/
@@ -12,6 +17,7 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 
 /* Types */
 
@@ -19,7 +25,9 @@
 typedef enum
 {
   ASCII = 2,
-  BINARY = 5
+  BINARY = 5,
+  PPM_ASCII = 3,
+  PPM_BINARY = 6
 } PGMType;
 
 /* Representation of a PGM image */
@@ -28,10 +36,47 @@ typedef struct
   PGMType type;     // Encoding format (ASCII or BINARY)
   size_t width;                 // Number of columns of array
   size_t height;                // Number of rows of array
+  size_t channels;              // Samples per pixel (1: gray, 3: RGB)
   uint16_t maxValue;            // Maximum gray value (do not edit)
-  uint16_t** array;             // Image of size 'height x width'
+  size_t bytesPerSample;        // 1 if maxValue <= 255, 2 otherwise
+  uint16_t** array;             // 16-bit image of size
+                                // 'height x (width*channels)' (or NULL)
+  uint8_t** array8;             // Same for 8-bit images (or NULL)
+  void* raster;                 // Contiguous storage behind the rows
 } PGM;
 
+/* Header of an image file: everything but the raster */
+typedef struct
+{
+  PGMType type;                 // Encoding format
+  size_t width;                 // Number of columns
+  size_t height;                // Number of rows
+  size_t channels;              // Samples per pixel (1: gray, 3: RGB)
+  uint16_t maxValue;            // Maximum gray value
+  size_t bytesPerSample;        // 1 if maxValue <= 255, 2 otherwise
+  long rasterOffset;            // Byte offset of the raster in the file
+                                // (binary formats only, -1 otherwise)
+} PGMHeader;
+
+/*
+ * Images whose maxValue fits on 8 bits are stored with one byte per sample
+ * (`array8`), the others with two bytes per sample (`array`). Use
+ * `getSample`/`setSample` when the sample size does not matter.
+ */
+static inline uint16_t getSample(const PGM* image, size_t i, size_t j)
+{
+  return image->bytesPerSample == 1 ? image->array8[i][j]
+                                    : image->array[i][j];
+}
+
+static inline void setSample(PGM* image, size_t i, size_t j, uint16_t value)
+{
+  if (image->bytesPerSample == 1)
+    image->array8[i][j] = (uint8_t)value;
+  else
+    image->array[i][j] = value;
+}
+
 /* Functions */
 
 /***********************************************************************
@@ -39,7 +84,7 @@ typedef struct
  * The image must later be deleted by calling deleteImage().
  *
  * PARAMETERS
- * filename     File name of a pgm image
+ * filename     File name of a pgm (P2/P5) or ppm (P3/P6) image
  *
  * RETURN
  * NULL         if any error
@@ -47,6 +92,85 @@ typedef struct
  ***********************************************************************/
 PGM* createImageFromFile(const char* filename);
 
+/***********************************************************************
+ * Read the header of an image. On success, `file` is positioned on the
+ * first sample of the raster.
+ *
+ * PARAMETERS
+ * file         A file opened for reading, positioned on the magic number
+ * header       Receives the header
+ *
+ * RETURN
+ * 0            If no error
+ * non-0        Otherwise
+ ***********************************************************************/
+int readImageHeader(FILE* file, PGMHeader* header);
+
+/***********************************************************************
+ * Read the header of an image file without reading its raster: its
+ * dimensions, type, bit depth and raster offset are known before the
+ * image is loaded (e.g. to schedule or budget a batch).
+ *
+ * PARAMETERS
+ * filename     File name of a pgm (P2/P5) or ppm (P3/P6) image
+ * header       Receives the header
+ *
+ * RETURN
+ * 0            If no error
+ * non-0        Otherwise
+ ***********************************************************************/
+int probeImage(const char* filename, PGMHeader* header);
+
+/* Size of the raster of an image once loaded, in bytes */
+static inline size_t rasterBytes(const PGMHeader* header)
+{
+  return header->width * header->height * header->channels
+         * header->bytesPerSample;
+}
+
+/***********************************************************************
+ * Read the next image of a stream. Netpbm streams may hold several
+ * images one after the other (e.g. the frames sent through a pipe): each
+ * call reads one of them and leaves `file` right after its raster.
+ * The image must later be deleted by calling deleteImage().
+ *
+ * PARAMETERS
+ * file         A file opened for reading, positioned on (or on the white
+ *              spaces before) the magic number of an image
+ *
+ * RETURN
+ * NULL         if any error
+ * image        The read image
+ ***********************************************************************/
+PGM* readImage(FILE* file);
+
+/***********************************************************************
+ * Skip the white spaces before the next image of a stream and tell
+ * whether there is one.
+ *
+ * PARAMETERS
+ * file         A file opened for reading
+ *
+ * RETURN
+ * 0            If another image follows
+ * non-0        At the end of the stream
+ ***********************************************************************/
+int endOfImages(FILE* file);
+
+/***********************************************************************
+ * Write an image to a stream, after what was already written (several
+ * images may be written one after the other). The stream is not flushed.
+ *
+ * PARAMETERS
+ * file         A file opened for writing
+ * image        The image to write
+ *
+ * RETURN
+ * 0            If no error
+ * non-0        Otherwise
+ ***********************************************************************/
+int writeImage(FILE* file, const PGM* image);
+
 /***********************************************************************
  * Save an image to a file.
  *
@@ -76,6 +200,23 @@ int saveImageToFile(const PGM* image, const char* filename);
 PGM* createEmptyImage(size_t width, size_t height,
                                   size_t numLevels);
 
+/***********************************************************************
+ * Create an empty image with several samples per pixel.
+ * The image must later be deleted by calling deleteImage().
+ *
+ * PARAMETERS
+ * width        The width of the image
+ * height       The height of the image
+ * channels     Number of samples per pixel (1 or 3)
+ * numLevels    Number of gray levels of the image
+ *
+ * RETURN
+ * NULL         if any error
+ * image        A new image where each sample is initialized to 0
+ ***********************************************************************/
+PGM* createEmptyMultiChannelImage(size_t width, size_t height,
+                                  size_t channels, size_t numLevels);
+
 /***********************************************************************
  * Delete an image.
  *
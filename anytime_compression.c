@@ -0,0 +1,215 @@
+/***********************************************************************
+ * Anytime mapping: a valid mapping is available at once and improved
+ * until the time budget runs out.
+ *
+ * 1. Seed: the better of the equal-population and uniform boundaries,
+ *    O(n + k log n).
+ * 2. Lloyd iterations: each value goes to its nearest level, then each
+ *    level becomes the best one of its interval; O(k) per iteration
+ *    with the prefix sums, until the error stops decreasing.
+ * 3. Windowed exact refinement (`refineBoundariesOnce`, pass by pass)
+ *    with windows of doubling width. Once a window covers the whole
+ *    histogram the mapping is proven optimal.
+ * A Lloyd iteration or a refinement pass is only started if it should end
+ * before the deadline: its cost in interval errors is known, and the time
+ * of an interval error is measured on the seed, then on every pass. An
+ * overrun is thus bounded by the misestimate of a single step.
+ * Up to FEW_LEVELS_MAX levels, the exact mapping is computed at once
+ * instead (see `fewLevelsMapping`).
+ ***********************************************************************/
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <time.h>
+
+#include "compression.h"
+
+// Maximum number of Lloyd iterations
+#define MAX_LLOYD_ITERATIONS 64
+// Half-width of the first refinement windows
+#define FIRST_WINDOW 2
+
+/* Monotonic time, in seconds */
+static double now(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+/* Interval errors of a refinement pass (see `refineBoundariesOnce`) */
+static double passSteps(size_t n, size_t k, size_t window)
+{
+    double width = 2. * window + 1 < n ? 2. * window + 1 : n;
+    return k * width * width;
+}
+
+/***********************************************************************
+ * One Lloyd iteration on the boundaries of k intervals: the new
+ * boundary between two levels is the first value nearer to the upper
+ * one. Boundaries are kept strictly increasing and in [i, n-k+i].
+ * Returns non-0 if nothing moved.
+ ***********************************************************************/
+static int lloydStep(const CumulativeHistogram *cumulative, size_t k,
+                     const size_t *boundaries, size_t *next)
+{
+    size_t n = cumulative->length;
+    uint16_t previous = 0, level = 0;
+    int moved = 0;
+
+    for(size_t i=0, begin=0; i+1<k; i++)
+    {
+        size_t end = boundaries[i];
+        intervalError(cumulative, begin, end, &previous);
+        size_t nextEnd = i+2 < k ? boundaries[i+1] : n;
+        intervalError(cumulative, end, nextEnd, &level);
+
+        // Values up to the middle of the two levels stay below
+        size_t p = ((size_t)previous + level) / 2 + 1;
+        size_t lo = i > 0 ? next[i-1] + 1 : 1;
+        size_t hi = n - k + i + 1;
+        next[i] = p < lo ? lo : p > hi ? hi : p;
+
+        moved = moved || next[i] != boundaries[i];
+        begin = end;
+    }
+
+    return !moved;
+}
+
+Mapping* anytimeMapping(const CumulativeHistogram *cumulative, size_t nLevels,
+                        double budget, double *error, bool *optimal)
+{
+    double deadline = now() + budget;
+    if(!cumulative || cumulative->length == 0 || nLevels == 0)
+        return NULL;
+
+    // 2 or 3 levels are solved exactly in less than the seed
+    if(nLevels <= FEW_LEVELS_MAX)
+    {
+        Mapping *mapping = fewLevelsMapping(cumulative, nLevels, NULL);
+        double total = 0;
+        for(size_t i=0, begin=0; mapping && i<mapping->nLevels; i++)
+        {
+            size_t end = mapping->thresholds[i];
+            if(end > begin)
+                total += intervalError(cumulative, begin, end, NULL);
+            begin = end > begin ? end : begin;
+        }
+        if(mapping && error)
+            *error = total;
+        if(mapping && optimal)
+            *optimal = true;
+        return mapping;
+    }
+
+    size_t n = cumulative->length;
+    size_t k = nLevels < n ? nLevels : n;
+    size_t *best = malloc(k * sizeof(size_t));
+    size_t *current = malloc(k * sizeof(size_t));
+    Mapping *seed = equalPopulationMapping(cumulative, nLevels, NULL);
+    if(!best || !current || !seed)
+    {
+        free(best);
+        free(current);
+        freeMapping(seed);
+        return NULL;
+    }
+
+    // 1. Seed: equal-population (its first k-1 thresholds) or uniform
+    memcpy(best, seed->thresholds, k * sizeof(size_t));
+    freeMapping(seed);
+    for(size_t i=1; i<k; i++)
+        current[i-1] = i * (n / k) + (i * (n % k)) / k;
+    double start = now();
+    double bestError = refineBoundaries(cumulative, k, 0, best, NULL);
+    double currentError = refineBoundaries(cumulative, k, 0, current, NULL);
+    // Time of an interval error (over-estimated by the clock reads)
+    double stepTime = (now() - start) / (2. * k);
+    if(currentError < bestError)
+    {
+        memcpy(best, current, k * sizeof(size_t));
+        bestError = currentError;
+    }
+
+    // One interval per value (or a single interval) cannot be improved
+    bool proven = k == n || k == 1 || bestError == 0;
+
+    // 2. Lloyd iterations while they improve the error (an iteration
+    // computes about 3k interval errors)
+    for(size_t it=0; !proven && it<MAX_LLOYD_ITERATIONS
+                     && now() + 3. * k * stepTime <= deadline; it++)
+    {
+        if(lloydStep(cumulative, k, best, current) != 0)
+            break;
+        currentError = refineBoundaries(cumulative, k, 0, current, NULL);
+        if(!(currentError < bestError))
+            break;
+        memcpy(best, current, k * sizeof(size_t));
+        bestError = currentError;
+    }
+
+    // 3. Exact refinement in windows of doubling width, pass by pass
+    bool expired = false;
+    for(size_t window=FIRST_WINDOW; !proven && !expired; window*=2)
+    {
+        double steps = passSteps(n, k, window);
+        bool settled = false;
+        memcpy(current, best, k * sizeof(size_t));
+        for(size_t pass=0; pass<MAX_REFINEMENTS && !settled; pass++)
+        {
+            start = now();
+            if(start + steps * stepTime > deadline)
+            {
+                expired = true;
+                break;
+            }
+
+            currentError = refineBoundariesOnce(cumulative, k, window,
+                                                current, &settled, NULL);
+            if(currentError == DBL_MAX)
+            {
+                expired = true;
+                break;
+            }
+            if(currentError < bestError)
+            {
+                memcpy(best, current, k * sizeof(size_t));
+                bestError = currentError;
+            }
+            stepTime = (now() - start) / steps;
+        }
+
+        // Every position was a candidate
+        proven = !expired && window >= n;
+    }
+
+    Mapping *mapping = createMappingFromBoundaries(cumulative, best, k,
+                                                   nLevels);
+    free(best);
+    free(current);
+    if(mapping && error)
+        *error = bestError;
+    if(mapping && optimal)
+        *optimal = proven;
+    return mapping;
+}
+
+Mapping* computeMappingAnytime(const Histogram *histogram, size_t nLevels,
+                               double budget, double *error, bool *optimal)
+{
+    double start = now();
+    CumulativeHistogram *cumulative = createCumulativeHistogram(histogram);
+    if(!cumulative)
+        return NULL;
+
+    Mapping *mapping = anytimeMapping(cumulative, nLevels,
+                                      budget - (now() - start), NULL,
+                                      optimal);
+    freeCumulativeHistogram(cumulative);
+    if(mapping && error)
+        *error = computeError(mapping, histogram);
+    return mapping;
+}
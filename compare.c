@@ -0,0 +1,640 @@
+/***********************************************************************
+ * Utility to compare original and quantized images
+ * gcc compare.c image_index.c PGM.c --std=c99 --pedantic -Wall -Wextra -Wmissing-prototypes -DNDEBUG -lm -pthread -o compare
+ *
+ * ./compare [-t threads] original quantized
+ *      Prints the squared error (SSE, the "Compression error" of the
+ *      compressor), the mean squared error per sample (MSE), the PSNR
+ *      (relative to the maximum value of the original) and the maximum
+ *      absolute error between the two images.
+ * ./compare [-t threads] [-x] -d originalDir quantizedDir
+ *      Same for every file of originalDir having a namesake in
+ *      quantizedDir, the pairs being compared in parallel (CSV on stdout,
+ *      sorted by name). The images are read by decreasing size, from the
+ *      index of originalDir (see image_index.h), so that a large image
+ *      does not end the batch alone; with -x, the index is saved in
+ *      originalDir for the next runs.
+ *
+ * Binary images (P5/P6) are mapped in memory and compared in place; the
+ * samples are processed by blocks with fixed-width integer accumulators,
+ * which the compiler vectorises, and the blocks of a pair are shared
+ * among the threads. ASCII images are loaded with `createImageFromFile`.
+ ***********************************************************************/
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "PGM.h"
+#include "image_index.h"
+
+// Maximum number of threads
+#define MAX_THREADS 64
+// Samples per block of the kernels (the 8-bit sums fit on 32 bits)
+#define BLOCK 4096
+// Smallest part of a pair given to a thread, in samples
+#define MIN_SAMPLES_PER_THREAD (1 << 20)
+
+/*-----------------------------------------------------------------------------+
+|                                 IMAGE VIEWS                                  |
++-----------------------------------------------------------------------------*/
+/* The samples of an image, mapped from its file or loaded */
+typedef struct
+{
+    PGMHeader header;
+    const uint8_t *samples;     // Raster, 16-bit samples most significant
+                                // byte first (as in the file)
+    size_t length;              // Number of samples
+    void *map;                  // Mapped file (or NULL)
+    size_t mapSize;
+    PGM *image;                 // Loaded image (or NULL)
+
+} ImageView;
+
+/***********************************************************************
+ * Open an image: the raster of a binary image is mapped from the file,
+ * an ASCII image is loaded (and its 16-bit samples stored most
+ * significant byte first, as in a binary file).
+ *
+ * PARAMETERS
+ * filename     The name of a PGM/PPM file
+ * view         Receives the view. It must be closed by calling
+ *              `closeView` (even in case of error)
+ *
+ * RETURN
+ * 0            If no error
+ * non-0        Otherwise
+ ***********************************************************************/
+static int openView(const char *filename, ImageView *view)
+{
+    *view = (ImageView){{ASCII, 0, 0, 0, 0, 0, -1}, NULL, 0, NULL, 0, NULL};
+
+    FILE *file = fopen(filename, "r");
+    if(!file)
+        return -1;
+    struct stat info;
+    int status = readImageHeader(file, &view->header) != 0
+                 || fstat(fileno(file), &info) != 0;
+    const PGMHeader *header = &view->header;
+    view->length = header->width * header->height * header->channels;
+
+    if(status == 0 && header->rasterOffset >= 0)
+    {
+        size_t end = (size_t)header->rasterOffset
+                   + view->length * header->bytesPerSample;
+        status = (size_t)info.st_size < end;
+        if(status == 0)
+        {
+            void *map = mmap(NULL, end > 0 ? end : 1, PROT_READ, MAP_PRIVATE,
+                             fileno(file), 0);
+            status = map == MAP_FAILED;
+            if(status == 0)
+            {
+                posix_madvise(map, end, POSIX_MADV_SEQUENTIAL);
+                view->map = map;
+                view->mapSize = end > 0 ? end : 1;
+                view->samples = (const uint8_t*)map + header->rasterOffset;
+            }
+        }
+    }
+    fclose(file);
+    if(status != 0 || view->map)
+        return status;
+
+    // ASCII image
+    view->image = createImageFromFile(filename);
+    if(!view->image)
+        return -1;
+    if(view->image->bytesPerSample == 2)
+    {
+        uint16_t *samples = view->image->raster;
+        for(size_t i=0; i<view->length; i++)
+        {
+            uint8_t bytes[2] = {samples[i] >> 8, samples[i] & 0xFF};
+            memcpy(&samples[i], bytes, 2);
+        }
+    }
+    view->samples = view->image->raster;
+    return 0;
+}
+
+/* Release the memory of a view */
+static void closeView(ImageView *view)
+{
+    if(view->map)
+        munmap(view->map, view->mapSize);
+    freeImage(view->image);
+}
+
+
+
+/*-----------------------------------------------------------------------------+
+|                                  KERNELS                                     |
++-----------------------------------------------------------------------------*/
+typedef struct
+{
+    unsigned long long sse;     // Sum of the squared errors
+    unsigned maxError;          // Maximum absolute error
+
+} Difference;
+
+/***********************************************************************
+ * Accumulate the differences of `length` samples of two rasters. The
+ * inner loops have no branch nor carried dependency but the (per block)
+ * sums and maxima, so that they are vectorised.
+ ***********************************************************************/
+static void difference8(const uint8_t *a, const uint8_t *b, size_t length,
+                        Difference *difference)
+{
+    for(size_t start=0; start<length; start+=BLOCK)
+    {
+        size_t end = length - start < BLOCK ? length : start + BLOCK;
+        uint32_t sse = 0;
+        uint8_t maxError = 0;
+        for(size_t i=start; i<end; i++)
+        {
+            int d = (int)a[i] - (int)b[i];
+            uint8_t e = (uint8_t)(d < 0 ? -d : d);
+            sse += (uint32_t)(d * d);
+            maxError = e > maxError ? e : maxError;
+        }
+        difference->sse += sse;
+        if(maxError > difference->maxError)
+            difference->maxError = maxError;
+    }
+}
+
+static void difference16(const uint8_t *a, const uint8_t *b, size_t length,
+                         Difference *difference)
+{
+    for(size_t start=0; start<length; start+=BLOCK)
+    {
+        size_t end = length - start < BLOCK ? length : start + BLOCK;
+        uint64_t sse = 0;
+        uint32_t maxError = 0;
+        for(size_t i=start; i<end; i++)
+        {
+            int32_t x = (a[2*i] << 8) | a[2*i+1];
+            int32_t y = (b[2*i] << 8) | b[2*i+1];
+            int32_t d = x - y;
+            uint32_t e = (uint32_t)(d < 0 ? -d : d);
+            sse += (uint64_t)e * e;
+            maxError = e > maxError ? e : maxError;
+        }
+        difference->sse += sse;
+        if(maxError > difference->maxError)
+            difference->maxError = maxError;
+    }
+}
+
+/* Part of a pair compared by one thread */
+typedef struct
+{
+    const ImageView *a;
+    const ImageView *b;
+    size_t begin;               // First sample
+    size_t end;                 // Past the last sample
+    Difference difference;
+
+} DifferenceJob;
+
+static void* differenceWorker(void *arg)
+{
+    DifferenceJob *job = arg;
+    size_t bytes = job->a->header.bytesPerSample;
+    const uint8_t *a = job->a->samples + job->begin * bytes;
+    const uint8_t *b = job->b->samples + job->begin * bytes;
+    if(bytes == 1)
+        difference8(a, b, job->end - job->begin, &job->difference);
+    else
+        difference16(a, b, job->end - job->begin, &job->difference);
+    return NULL;
+}
+
+/***********************************************************************
+ * Differences between two images of the same dimensions, the samples
+ * being split among at most `maxThreads` threads.
+ *
+ * RETURN
+ * 0            If no error
+ * non-0        Otherwise (the images do not have the same dimensions)
+ ***********************************************************************/
+static int compareViews(const ImageView *a, const ImageView *b,
+                        size_t maxThreads, Difference *difference)
+{
+    if(a->header.width != b->header.width
+       || a->header.height != b->header.height
+       || a->header.channels != b->header.channels
+       || a->header.bytesPerSample != b->header.bytesPerSample)
+        return -1;
+
+    size_t length = a->length;
+    size_t numThreads = length / MIN_SAMPLES_PER_THREAD;
+    if(numThreads > maxThreads)
+        numThreads = maxThreads;
+    if(numThreads > MAX_THREADS)
+        numThreads = MAX_THREADS;
+    if(numThreads == 0)
+        numThreads = 1;
+
+    // Split on block boundaries, the first part runs here
+    DifferenceJob jobs[MAX_THREADS];
+    pthread_t threads[MAX_THREADS];
+    bool started[MAX_THREADS] = {false};
+    size_t blocks = (length + BLOCK - 1) / BLOCK;
+    for(size_t t=0; t<numThreads; t++)
+    {
+        size_t begin = blocks * t / numThreads * BLOCK;
+        size_t end = blocks * (t+1) / numThreads * BLOCK;
+        jobs[t] = (DifferenceJob){a, b, begin, end < length ? end : length,
+                                  {0, 0}};
+        if(t > 0)
+            started[t] = pthread_create(&threads[t], NULL, differenceWorker,
+                                        &jobs[t]) == 0;
+    }
+
+    *difference = (Difference){0, 0};
+    for(size_t t=0; t<numThreads; t++)
+    {
+        if(started[t])
+            pthread_join(threads[t], NULL);
+        else
+            differenceWorker(&jobs[t]); // Inline fallback
+        difference->sse += jobs[t].difference.sse;
+        if(jobs[t].difference.maxError > difference->maxError)
+            difference->maxError = jobs[t].difference.maxError;
+    }
+    return 0;
+}
+
+/***********************************************************************
+ * Compare two image files (see `compareViews`).
+ *
+ * PARAMETERS
+ * original     The name of the original image
+ * quantized    The name of the quantized image
+ * maxThreads   The maximum number of threads
+ * difference   Receives the differences
+ * length       Receives the number of samples
+ * maxValue     Receives the maximum value of the original image
+ *
+ * RETURN
+ * 0            If no error
+ * non-0        Otherwise
+ ***********************************************************************/
+static int compareFiles(const char *original, const char *quantized,
+                        size_t maxThreads, Difference *difference,
+                        size_t *length, uint16_t *maxValue)
+{
+    ImageView a, b;
+    int status = openView(original, &a);
+    status = openView(quantized, &b) != 0 || status != 0
+             || compareViews(&a, &b, maxThreads, difference) != 0;
+    *length = a.length;
+    *maxValue = a.header.maxValue;
+    closeView(&a);
+    closeView(&b);
+    return status;
+}
+
+/* Mean squared error and PSNR (in dB, infinite for identical images) */
+static double meanSquaredError(const Difference *difference, size_t length)
+{
+    return length > 0 ? (double)difference->sse / length : 0.;
+}
+
+static double psnr(double mse, uint16_t maxValue)
+{
+    return mse > 0 ? 10. * log10((double)maxValue * maxValue / mse)
+                   : INFINITY;
+}
+
+
+
+/*-----------------------------------------------------------------------------+
+|                                 DIRECTORIES                                  |
++-----------------------------------------------------------------------------*/
+/* Pairs of a directory comparison, shared by the workers */
+typedef struct
+{
+    const char *originalDir;
+    const char *quantizedDir;
+    char **names;               // Names of the files (sorted)
+    size_t count;               // Number of files
+    const size_t *order;        // Files in the order of the comparisons
+    size_t next;                // Next comparison
+    pthread_mutex_t lock;
+    Difference *differences;    // Result of each pair
+    size_t *lengths;
+    uint16_t *maxValues;
+    int *status;                // Non-0 if a pair could not be compared
+
+} DirectoryJob;
+
+/* Path of a file of a directory, to be free with `free` (NULL if error) */
+static char* joinPath(const char *directory, const char *name)
+{
+    size_t size = strlen(directory) + strlen(name) + 2;
+    char *path = malloc(size);
+    if(path)
+        snprintf(path, size, "%s/%s", directory, name);
+    return path;
+}
+
+/***********************************************************************
+ * Worker of a directory comparison: takes the next pair until none is
+ * left. Each pair is compared on a single thread.
+ ***********************************************************************/
+static void* directoryWorker(void *arg)
+{
+    DirectoryJob *job = arg;
+    while(true)
+    {
+        pthread_mutex_lock(&job->lock);
+        size_t next = job->next++;
+        pthread_mutex_unlock(&job->lock);
+        if(next >= job->count)
+            return NULL;
+
+        size_t f = job->order[next];
+
+        char *original = joinPath(job->originalDir, job->names[f]);
+        char *quantized = joinPath(job->quantizedDir, job->names[f]);
+        job->status[f] = !original || !quantized
+                         || compareFiles(original, quantized, 1,
+                                         &job->differences[f],
+                                         &job->lengths[f],
+                                         &job->maxValues[f]) != 0;
+        free(original);
+        free(quantized);
+    }
+}
+
+static int compareNames(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static int compareIndexNames(const void *a, const void *b)
+{
+    return strcmp(((const IndexEntry*)a)->name, ((const IndexEntry*)b)->name);
+}
+
+/***********************************************************************
+ * Names of the regular files of `originalDir` that also exist in
+ * `quantizedDir`, sorted. The others are reported on stderr.
+ *
+ * RETURN
+ * names        The `*count` names. They must be free with `free`, as well
+ *              as the array
+ * NULL         In case of error
+ ***********************************************************************/
+static char** listPairs(const char *originalDir, const char *quantizedDir,
+                        size_t *count)
+{
+    DIR *directory = opendir(originalDir);
+    if(!directory)
+        return NULL;
+
+    size_t capacity = 64, n = 0;
+    char **names = malloc(capacity * sizeof(char*));
+    struct dirent *entry;
+    while(names && (entry = readdir(directory)))
+    {
+        char *original = joinPath(originalDir, entry->d_name);
+        char *quantized = joinPath(quantizedDir, entry->d_name);
+        struct stat info;
+        bool regular = original && stat(original, &info) == 0
+                       && S_ISREG(info.st_mode)
+                       && strncmp(entry->d_name, IMAGE_INDEX_NAME,
+                                  strlen(IMAGE_INDEX_NAME)) != 0;
+        bool paired = regular && quantized && stat(quantized, &info) == 0;
+        free(original);
+        free(quantized);
+        if(regular && !paired)
+            fprintf(stderr, "Skipping '%s': not in '%s'\n", entry->d_name,
+                    quantizedDir);
+        if(!paired)
+            continue;
+
+        if(n == capacity)
+        {
+            char **larger = realloc(names, 2 * capacity * sizeof(char*));
+            if(!larger)
+                break;
+            names = larger;
+            capacity *= 2;
+        }
+        names[n] = malloc(strlen(entry->d_name) + 1);
+        if(!names[n])
+            break;
+        strcpy(names[n++], entry->d_name);
+    }
+    closedir(directory);
+
+    if(names)
+        qsort(names, n, sizeof(char*), compareNames);
+    *count = n;
+    return names;
+}
+
+/* A file and the size of its raster, to schedule the largest first */
+typedef struct
+{
+    size_t file;
+    size_t bytes;
+
+} ScheduledFile;
+
+static int compareScheduled(const void *a, const void *b)
+{
+    const ScheduledFile *fileA = a, *fileB = b;
+    if(fileA->bytes != fileB->bytes)
+        return fileA->bytes > fileB->bytes ? -1 : 1;
+    return fileA->file < fileB->file ? -1 : fileA->file > fileB->file;
+}
+
+/***********************************************************************
+ * Order of the comparisons of the `count` sorted `names` of
+ * `originalDir`: by decreasing raster size, from the index of the
+ * directory (saved if `saveIndex`); by name if it cannot be indexed.
+ *
+ * RETURN
+ * order        The `count` files, to be free with `free`
+ * NULL         In case of error
+ ***********************************************************************/
+static size_t* scheduleLargestFirst(const char *originalDir,
+                                    char *const *names, size_t count,
+                                    bool saveIndex)
+{
+    ScheduledFile *files = malloc((count + 1) * sizeof(ScheduledFile));
+    size_t *order = malloc((count + 1) * sizeof(size_t));
+    ImageIndex *index = indexDirectory(originalDir);
+    if(!index)
+        fprintf(stderr, "Cannot index '%s': comparing by name\n",
+                originalDir);
+    else if(saveIndex && index->modified
+            && saveImageIndex(index, originalDir) != 0)
+        fprintf(stderr, "Cannot save the index of '%s'\n", originalDir);
+
+    for(size_t f=0; files && f<count; f++)
+    {
+        IndexEntry key = {names[f], {0}, 0, 0};
+        const IndexEntry *entry = index && index->count > 0
+            ? bsearch(&key, index->entries, index->count, sizeof(IndexEntry),
+                      compareIndexNames)
+            : NULL;
+        files[f] = (ScheduledFile){f, entry ? rasterBytes(&entry->header)
+                                            : 0};
+    }
+    if(files)
+        qsort(files, count, sizeof(ScheduledFile), compareScheduled);
+    for(size_t f=0; files && order && f<count; f++)
+        order[f] = files[f].file;
+
+    freeImageIndex(index);
+    free(files);
+    if(!files)
+    {
+        free(order);
+        return NULL;
+    }
+    return order;
+}
+
+/***********************************************************************
+ * Compare the pairs of two directories with `maxThreads` workers and
+ * print one CSV record per pair.
+ *
+ * RETURN
+ * 0            If every pair was compared
+ * non-0        Otherwise
+ ***********************************************************************/
+static int compareDirectories(const char *originalDir,
+                              const char *quantizedDir, size_t maxThreads,
+                              bool saveIndex)
+{
+    size_t count = 0;
+    char **names = listPairs(originalDir, quantizedDir, &count);
+    if(!names)
+    {
+        fprintf(stderr, "Cannot list '%s'\n", originalDir);
+        return -1;
+    }
+
+    size_t *order = scheduleLargestFirst(originalDir, names, count,
+                                         saveIndex);
+    DirectoryJob job = {originalDir, quantizedDir, names, count, order, 0,
+                        PTHREAD_MUTEX_INITIALIZER,
+                        malloc((count + 1) * sizeof(Difference)),
+                        malloc((count + 1) * sizeof(size_t)),
+                        malloc((count + 1) * sizeof(uint16_t)),
+                        malloc((count + 1) * sizeof(int))};
+    int status = order && job.differences && job.lengths && job.maxValues
+                 && job.status ? 0 : -1;
+
+    size_t numThreads = maxThreads < count ? maxThreads : count;
+    if(numThreads > MAX_THREADS)
+        numThreads = MAX_THREADS;
+    pthread_t threads[MAX_THREADS];
+    bool started[MAX_THREADS] = {false};
+    for(size_t t=1; t<numThreads && status == 0; t++)
+        started[t] = pthread_create(&threads[t], NULL, directoryWorker,
+                                    &job) == 0;
+    if(status == 0)
+        directoryWorker(&job);
+    for(size_t t=1; t<numThreads; t++)
+        if(started[t])
+            pthread_join(threads[t], NULL);
+
+    if(status == 0)
+        printf("image,samples,sse,mse,psnr_db,max_error\n");
+    for(size_t f=0; f<count && status == 0; f++)
+    {
+        if(job.status[f] != 0)
+        {
+            fprintf(stderr, "Error while comparing '%s'\n", names[f]);
+            continue;
+        }
+        double mse = meanSquaredError(&job.differences[f], job.lengths[f]);
+        printf("%s,%zu,%llu,%f,%f,%u\n", names[f], job.lengths[f],
+               job.differences[f].sse, mse, psnr(mse, job.maxValues[f]),
+               job.differences[f].maxError);
+    }
+    for(size_t f=0; f<count && status == 0; f++)
+        status = job.status[f];
+
+    for(size_t f=0; f<count; f++)
+        free(names[f]);
+    free(names);
+    free(order);
+    free(job.differences);
+    free(job.lengths);
+    free(job.maxValues);
+    free(job.status);
+    return status;
+}
+
+
+
+int main(int argc, char** argv)
+{
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t maxThreads = cores > 0 ? (size_t)cores : 1;
+    bool directories = false, saveIndex = false;
+    int arg = 1;
+    for(; arg < argc && argv[arg][0] == '-'; arg++)
+    {
+        if(strcmp(argv[arg], "-d") == 0)
+            directories = true;
+        else if(strcmp(argv[arg], "-x") == 0)
+            saveIndex = true;
+        else if(strcmp(argv[arg], "-t") == 0 && arg+1 < argc
+                && sscanf(argv[arg+1], "%zu", &maxThreads) == 1
+                && maxThreads > 0)
+            arg++;
+        else
+            break;
+    }
+
+    if(argc - arg != 2)
+    {
+        fprintf(stderr, "Usage: %s [-t <threads>] <original> <quantized>\n"
+                        "       %s [-t <threads>] [-x] -d <original directory> "
+                        "<quantized directory>\n", argv[0], argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if(directories)
+        return compareDirectories(argv[arg], argv[arg+1], maxThreads,
+                                  saveIndex) == 0
+               ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    Difference difference;
+    size_t length;
+    uint16_t maxValue;
+    if(compareFiles(argv[arg], argv[arg+1], maxThreads, &difference, &length,
+                    &maxValue) != 0)
+    {
+        fprintf(stderr, "Error while comparing '%s' and '%s' (unreadable "
+                        "or different dimensions)\n", argv[arg],
+                argv[arg+1]);
+        return EXIT_FAILURE;
+    }
+
+    double mse = meanSquaredError(&difference, length);
+    printf("SSE: %llu\n", difference.sse);
+    printf("MSE: %f\n", mse);
+    printf("PSNR: %f dB\n", psnr(mse, maxValue));
+    printf("Max error: %u\n", difference.maxError);
+    return EXIT_SUCCESS;
+}
@@ -11,6 +11,20 @@
 
 #include "Mapping.h"
 
+// Maximum depth of nested mappings (256 levels, one byte per index)
+#define MAX_NESTED_DEPTH 8
+// Histogram length and maximum number of levels of `exactMapping8`
+#define EXACT8_LENGTH 256
+#define EXACT8_MAX_LEVELS 64
+// Largest number of pixels of `exactMapping8`: its interval errors sum
+// integers up to 2 pixels 255^2, exact in doubles up to 2^53
+#define EXACT8_MAX_PIXELS ((1ULL << 52) / (255 * 255))
+// Maximum number of levels of `fewLevelsMapping`
+#define FEW_LEVELS_MAX 3
+// Maximum number of passes of `refineBoundaries` (a pass re-centres the
+// windows of the boundaries that ended on the border of their window)
+#define MAX_REFINEMENTS 8
+
 
 /*************************************************************************
  * Compute the mapping which represents the image compression.
@@ -27,5 +41,371 @@ Mapping* computeMapping(const Histogram* histogram, size_t nLevels);
 
 
 
+/*************************************************************************
+ * Compute the equal-population mapping: the thresholds are the
+ * k-quantiles of the histogram and each level is the rounded centroid
+ * of its interval. O(n + k log n) for a histogram of length n.
+ *
+ * PARAMETERS
+ * histogram    A valid pointer to an Histogram
+ * nLevels      The number of levels (k)
+ *
+ * RETURN
+ * mapping     A pointer to a Mapping. It must be deleted by calling
+ *             `freeMapping`
+ * NULL        In case of error
+ *************************************************************************/
+Mapping* computeMappingEqualPopulation(const Histogram *histogram,
+                                       size_t nLevels);
+
+
+/*************************************************************************
+ * Same as `computeMappingEqualPopulation` from prefix sums that are
+ * already computed, in O(k log n) (e.g. to seed another solver). The
+ * quantiles are those of the pixel counts; the levels are the best ones
+ * for the metric of `cumulative`.
+ *
+ * PARAMETERS
+ * cumulative   A valid pointer to a CumulativeHistogram
+ * nLevels      The number of levels (k)
+ * arena        The mapping and the temporary memory are allocated from it
+ *              (see `createMappingFromBoundariesInArena`), NULL for the
+ *              heap
+ *
+ * RETURN
+ * mapping     A pointer to a Mapping. It must be deleted by calling
+ *             `freeMapping` if `arena` is NULL
+ * NULL        In case of error
+ *************************************************************************/
+Mapping* equalPopulationMapping(const CumulativeHistogram *cumulative,
+                                size_t nLevels, Arena *arena);
+
+
+/*************************************************************************
+ * Prefix sums over the `distinct` non-empty bins only: entry j covers the
+ * j first non-empty bins, whose values are stored in `values`. The sums
+ * are those of the actual values, so `intervalError` still gives actual
+ * levels (and the metric of `full` is kept). A boundary j of the compact
+ * histogram is the gray value `values[j]` (the length of `full` if
+ * j = distinct).
+ *
+ * PARAMETERS
+ * full         A valid pointer to a CumulativeHistogram without `values`
+ * distinct     The number of non-empty bins of `full` (> 0)
+ * arena        See `exactMapping`
+ *
+ * RETURN
+ * cumulative   A pointer to a CumulativeHistogram. It must be deleted by
+ *              calling `freeCumulativeHistogramInArena`
+ * NULL         In case of error
+ *************************************************************************/
+CumulativeHistogram* createCompactCumulative(const CumulativeHistogram *full,
+                                             size_t distinct, Arena *arena);
+
+
+/*************************************************************************
+ * Compute the mapping of minimal error (see `computeError`) by dynamic
+ * programming on the prefix sums of the histogram, in O(k d^2) time and
+ * O(k d) memory for a histogram with d non-empty bins (d <= n, its
+ * length).
+ *
+ * PARAMETERS
+ * histogram    A valid pointer to an Histogram
+ * nLevels      The number of levels (k)
+ *
+ * RETURN
+ * mapping     A pointer to a Mapping. It must be deleted by calling
+ *             `freeMapping`
+ * NULL        In case of error
+ *************************************************************************/
+Mapping* computeMappingExact(const Histogram *histogram, size_t nLevels);
+
+
+/*************************************************************************
+ * Same as `computeMappingExact` from prefix sums that are already
+ * computed. The error minimized is the metric of `cumulative` (see
+ * `createMetricCumulativeHistogram`); with NORM_L1, the time is
+ * O(k d^2 log d).
+ *
+ * PARAMETERS
+ * cumulative   A valid pointer to a CumulativeHistogram
+ * nLevels      The number of levels (k)
+ * arena        The mapping and the temporary memory are allocated from it
+ *              (see `createMappingFromBoundariesInArena`), NULL for the
+ *              heap
+ *
+ * RETURN
+ * mapping     A pointer to a Mapping. It must be deleted by calling
+ *             `freeMapping` if `arena` is NULL
+ * NULL        In case of error
+ *************************************************************************/
+Mapping* exactMapping(const CumulativeHistogram *cumulative, size_t nLevels,
+                      Arena *arena);
+
+
+/*************************************************************************
+ * `computeMappingExact` specialised for 8-bit histograms (EXACT8_LENGTH
+ * values, at most EXACT8_MAX_LEVELS levels, squared error, at most
+ * EXACT8_MAX_PIXELS pixels): the tables have a size known at compile
+ * time and are taken at once (about 2.5 KiB per level), never from the
+ * stack. Same error as `computeMappingExact`, in O(k n^2) with small
+ * constants.
+ *
+ * PARAMETERS
+ * histogram    A valid pointer to an Histogram of EXACT8_LENGTH values
+ * nLevels      The number of levels (k), at most EXACT8_MAX_LEVELS
+ * thresholds   Receives the k thresholds (the last one is EXACT8_LENGTH)
+ * levels       Receives the k levels
+ * arena        Temporary memory (given back on return), NULL for the heap
+ *
+ * RETURN
+ * error        The error of the mapping, DBL_MAX in case of error (or
+ *              if the histogram has more than EXACT8_MAX_PIXELS pixels)
+ *************************************************************************/
+double exactMapping8(const Histogram *histogram, size_t nLevels,
+                     size_t *thresholds, uint16_t *levels, Arena *arena);
+
+
+/*************************************************************************
+ * Same as `exactMapping8`, returning the result as a Mapping.
+ *
+ * PARAMETERS
+ * histogram    A valid pointer to an Histogram of EXACT8_LENGTH values
+ * nLevels      The number of levels (k), at most EXACT8_MAX_LEVELS
+ *
+ * RETURN
+ * mapping     A pointer to a Mapping. It must be deleted by calling
+ *             `freeMapping`
+ * NULL        In case of error (or more than EXACT8_MAX_PIXELS pixels)
+ *************************************************************************/
+Mapping* computeMappingExact8(const Histogram *histogram, size_t nLevels);
+
+
+/*************************************************************************
+ * `computeMappingExact` for 2 or 3 levels: a single sweep over the
+ * prefix sums for k = 2, in O(d), and a divide and conquer on the
+ * monotone best split for k = 3, in O(d log d), for a histogram with d
+ * non-empty bins. Same error as `computeMappingExact`.
+ *
+ * PARAMETERS
+ * histogram    A valid pointer to an Histogram
+ * nLevels      The number of levels (k), at most FEW_LEVELS_MAX
+ *
+ * RETURN
+ * mapping     A pointer to a Mapping. It must be deleted by calling
+ *             `freeMapping`
+ * NULL        In case of error
+ *************************************************************************/
+Mapping* computeMappingFewLevels(const Histogram *histogram, size_t nLevels);
+
+
+/*************************************************************************
+ * Same as `computeMappingFewLevels` from prefix sums that are already
+ * computed, for the metric of `cumulative` (O(log d) more per interval
+ * error with NORM_L1).
+ *
+ * PARAMETERS
+ * cumulative   A valid pointer to a CumulativeHistogram
+ * nLevels      The number of levels (k), at most FEW_LEVELS_MAX
+ * arena        See `exactMapping`
+ *
+ * RETURN
+ * mapping     A pointer to a Mapping. It must be deleted by calling
+ *             `freeMapping` if `arena` is NULL
+ * NULL        In case of error
+ *************************************************************************/
+Mapping* fewLevelsMapping(const CumulativeHistogram *cumulative,
+                          size_t nLevels, Arena *arena);
+
+
+/*************************************************************************
+ * Improve the boundaries p_1 < ... < p_{k-1} of a mapping: each of them
+ * is moved optimally within +/- `window` values of its position (the
+ * other ones moving as well), and the windows are re-centred on the
+ * boundaries ending on their border, for a few passes. Costs
+ * O(k window^2) per pass; the result is optimal when `window >= n`.
+ *
+ * PARAMETERS
+ * cumulative   A valid pointer to a CumulativeHistogram
+ * k            The number of intervals (1 <= k <= length)
+ * window       Half-width of the windows (0 only evaluates the error)
+ * boundaries   The k-1 increasing boundaries, replaced by the refined
+ *              ones (each p_i in [i, length-k+i])
+ * arena        Temporary memory (given back on return), NULL for the heap
+ *
+ * RETURN
+ * error        The error of the refined boundaries (see `intervalError`),
+ *              DBL_MAX in case of error
+ *************************************************************************/
+double refineBoundaries(const CumulativeHistogram *cumulative, size_t k,
+                        size_t window, size_t *boundaries, Arena *arena);
+
+
+/*************************************************************************
+ * One pass of `refineBoundaries`, so that the caller can stop between
+ * passes. A pass costs about k min(2 window + 1, length)^2 interval
+ * errors.
+ *
+ * PARAMETERS
+ * cumulative   A valid pointer to a CumulativeHistogram
+ * k            The number of intervals (1 <= k <= length)
+ * window       Half-width of the windows
+ * boundaries   The k-1 increasing boundaries, replaced by the refined ones
+ * settled      Set to true if no boundary ended on the border of its
+ *              window (another pass would not move them)
+ * arena        Temporary memory (given back on return), NULL for the heap
+ *
+ * RETURN
+ * error        The error of the refined boundaries, DBL_MAX in case of
+ *              error
+ *************************************************************************/
+double refineBoundariesOnce(const CumulativeHistogram *cumulative, size_t k,
+                            size_t window, size_t *boundaries, bool *settled,
+                            Arena *arena);
+
+
+/*************************************************************************
+ * Coarse-to-fine version of `computeMappingExact` for wide histograms.
+ * The thresholds are first chosen optimally among the multiples of
+ * n/coarseLength (a binned histogram, with exact errors), then each of
+ * them is refined at full resolution within +/- `window` values of its
+ * coarse position. Costs O(k coarseLength^2 + k window^2).
+ *
+ * A window of at least n/coarseLength usually recovers the optimal
+ * mapping; the result is exact when `window >= n`. A window of 0 keeps
+ * the coarse thresholds.
+ *
+ * PARAMETERS
+ * histogram    A valid pointer to an Histogram
+ * nLevels      The number of levels (k)
+ * coarseLength Number of bins of the coarse solve (e.g. 256 or 1024)
+ * window       Half-width of the refinement windows
+ *
+ * RETURN
+ * mapping     A pointer to a Mapping. It must be deleted by calling
+ *             `freeMapping`
+ * NULL        In case of error
+ *************************************************************************/
+Mapping* computeMappingCoarseToFine(const Histogram *histogram,
+                                    size_t nLevels, size_t coarseLength,
+                                    size_t window);
+
+
+/*************************************************************************
+ * Same as `computeMappingCoarseToFine` from prefix sums that are already
+ * computed, minimizing the metric of `cumulative`.
+ *
+ * PARAMETERS
+ * cumulative   A valid pointer to a CumulativeHistogram
+ * nLevels      The number of levels (k)
+ * coarseLength Number of bins of the coarse solve
+ * window       Half-width of the refinement windows
+ * arena        See `exactMapping`
+ *
+ * RETURN
+ * mapping     A pointer to a Mapping. It must be deleted by calling
+ *             `freeMapping` if `arena` is NULL
+ * NULL        In case of error
+ *************************************************************************/
+Mapping* coarseToFineMapping(const CumulativeHistogram *cumulative,
+                             size_t nLevels, size_t coarseLength,
+                             size_t window, Arena *arena);
+
+
+
+/*************************************************************************
+ * Anytime mapping: returns the best mapping found within a time budget.
+ * A valid mapping (equal-population or uniform bins) is found at once,
+ * then improved by Lloyd iterations and by exact refinement in windows of
+ * doubling width, as long as time remains. The mapping is proven optimal
+ * once a window covers the whole histogram.
+ *
+ * PARAMETERS
+ * histogram    A valid pointer to an Histogram
+ * nLevels      The number of levels (k)
+ * budget       The time budget, in seconds (a mapping is returned even if
+ *              it is exceeded, with the seed quality)
+ * error        If not NULL, receives the error of the mapping (see
+ *              `computeError`)
+ * optimal      If not NULL, receives whether the mapping is proven optimal
+ *
+ * RETURN
+ * mapping     A pointer to a Mapping. It must be deleted by calling
+ *             `freeMapping`
+ * NULL        In case of error
+ *************************************************************************/
+Mapping* computeMappingAnytime(const Histogram *histogram, size_t nLevels,
+                               double budget, double *error, bool *optimal);
+
+
+/*************************************************************************
+ * Same as `computeMappingAnytime` from prefix sums that are already
+ * computed, minimizing the metric of `cumulative`.
+ *
+ * PARAMETERS
+ * cumulative   A valid pointer to a CumulativeHistogram
+ * nLevels      The number of levels (k)
+ * budget       The time budget, in seconds
+ * error        If not NULL, receives the error of the mapping for the
+ *              metric of `cumulative` (see `intervalError`)
+ * optimal      If not NULL, receives whether the mapping is proven optimal
+ *
+ * RETURN
+ * mapping     A pointer to a Mapping. It must be deleted by calling
+ *             `freeMapping`
+ * NULL        In case of error
+ *************************************************************************/
+Mapping* anytimeMapping(const CumulativeHistogram *cumulative, size_t nLevels,
+                        double budget, double *error, bool *optimal);
+
+/*************************************************************************
+ * Nested mappings for progressive transmission: mapping j (j = 1..depth)
+ * has 2^j levels, and each of its intervals is split in two by mapping
+ * j+1 (the thresholds of a level are a superset of those of the previous
+ * one). The index of a value at level j is thus its index at the last
+ * level shifted right by depth-j bits: each level adds one bit per pixel.
+ *
+ * The hierarchy minimizes the sum of the errors (see `computeError`) of
+ * all its levels, in O(depth d^3) time and O(depth d^2) memory for a
+ * histogram with d non-empty bins. Beyond 512 non-empty bins, each
+ * interval is instead split optimally in two, level by level (O(depth d)):
+ * the hierarchy is then approximate (see `optimal`).
+ *
+ * PARAMETERS
+ * histogram    A valid pointer to an Histogram
+ * depth        The number of levels of the hierarchy (1 to
+ *              MAX_NESTED_DEPTH), i.e. 2^depth levels at the end
+ * mappings     An array of `depth` pointers receiving the mappings. They
+ *              must be deleted by calling `freeMapping`
+ * optimal      If not NULL, set to whether the hierarchy minimizes the sum
+ *              of the errors (false if it was split level by level)
+ *
+ * RETURN
+ * depth        The number of mappings computed: less than `depth` if the
+ *              histogram has less than 2^depth non-empty bins (the other
+ *              entries are set to NULL)
+ * 0            In case of error
+ *************************************************************************/
+size_t computeNestedMappings(const Histogram *histogram, size_t depth,
+                             Mapping **mappings, bool *optimal);
+
+
+/*************************************************************************
+ * Same as `computeNestedMappings` from prefix sums that are already
+ * computed, minimizing the metric of `cumulative`.
+ *
+ * PARAMETERS
+ * cumulative   A valid pointer to a CumulativeHistogram
+ * depth        The number of levels of the hierarchy
+ * mappings     An array of `depth` pointers receiving the mappings
+ * optimal      If not NULL, set to whether the hierarchy is optimal
+ *
+ * RETURN
+ * depth        The number of mappings computed, 0 in case of error
+ *************************************************************************/
+size_t nestedMappings(const CumulativeHistogram *cumulative, size_t depth,
+                      Mapping **mappings, bool *optimal);
+
+
 #endif // !_COMPRESSION_H_
 
@@ -1,88 +1,688 @@
-/***********************************************************************
- * Utility to measure compression time
- * gcc emp_time.c naive_compression.c Mapping.c --std=c99 --pedantic -Wall -Wextra -Wmissing-prototypes -DNDEBUG -lm -o timeit
- ***********************************************************************/
-
-#include <stdlib.h>
-#include <stdio.h>
-#include <time.h>
-
-#include "Histogram.h"
-#include "compression.h"
-
-/*-----------------------------------------------------------------------------+
-|                          HISTOGRAM GENERATION                                |
-+-----------------------------------------------------------------------------*/
-static Histogram* histoGen(size_t length, unsigned long long totalCount)
-{
-    Histogram *hist = createEmptyHistogram(length);
-    if(!hist)
-        return NULL;
-
-    // Distribute occurences uniformly with excess on first slot
-    unsigned long long perBin = totalCount / length;
-    hist->count[0] = totalCount - (perBin * length);
-    for(size_t i=0; i<length; i++)
-        hist->count[i] += perBin;
-
-    // Perturb the distribution
-    // 1. remove randomly from each bin
-    unsigned long long excess = 0, rem;
-    for(size_t i=0; i<length; i++)
-    {
-        rem = rand() % hist->count[i];
-        hist->count[i] -= rem;
-        excess += rem;
-    }
-    fprintf(stderr, "Excess: %llu\n", excess); // TODO
-
-    // 2. redistribute excess as uniformly as possible
-    perBin = excess / length;
-    for(size_t i=0; i<length; i++)
-        hist->count[i] += perBin;
-    excess = excess - (perBin * length);
-
-    while(excess-- > 0)
-            hist->count[rand() % length] += 1;
-
-    return hist;
-}
-
-
-
-/*-----------------------------------------------------------------------------+
-|                                  MAIN                                        |
-+-----------------------------------------------------------------------------*/
-/***********************************************************************
- * Measure the time needed to compute the mapping for the compression
- *
- * PARAMETERS
- * histogram   A valid pointer to an Histogram
- * nLevels     The number of levels for the compression
- *
- * RETURN
- * duration    The duration of the computation in seconds
- ***********************************************************************/
-static double cpuTimeUsed(const Histogram* histogram, size_t nLevels)
-{
-    clock_t start = clock();
-    Mapping* mapping = computeMapping(histogram, nLevels);
-    clock_t end = clock();
-    freeMapping(mapping);
-
-    return ((double) (end - start)) / CLOCKS_PER_SEC;
-}
-
-int main(void)
-{
-    srand(time(NULL));//Use an integer seed to get a fix sequence
-
-    /*
-     * Do your experiment here. You can use `histoGen` to generate histograms
-     * and cpuTimeUsed to measure the time needed to build the mapping
-     */
-
-
-    return EXIT_SUCCESS;
-}
-
+/***********************************************************************
+ * Utility to measure compression time
+ * gcc emp_time.c multires_compression.c exact8_compression.c fewlevels_compression.c quantile_compression.c anytime_compression.c progressive_compression.c planner.c workspace.c perf_counters.c loader.c Mapping.c PGM.c quantizer.c sampling.c --std=c99 --pedantic -Wall -Wextra -Wmissing-prototypes -DNDEBUG -lm -pthread -o timeit
+ *
+ * ./timeit
+ *      Compares the coarse-to-fine and equal-population solvers with the
+ *      exact one on generated histograms, evaluates the anytime solver
+ *      for several time budgets and measures the batch throughput of
+ *      the solvers with and without a SolverWorkspace and the latency of
+ *      the 8-bit exact solver (CSV on stdout).
+ * ./timeit [-c] image ...
+ *      For each image, compares the mappings computed from sampled
+ *      histograms with the one computed from the full histogram, then
+ *      times the loading, histogram, mapping and remap phases of a
+ *      compression, and the parallel loading with histogram (CSV on
+ *      stdout). With -c, the hardware counters (cycles,
+ *      instructions, L1/LLC misses, branch misses) of each phase are
+ *      added to its record; the counters the system does not provide
+ *      (e.g. in a container) are "NA".
+ ***********************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <float.h>
+#include <time.h>
+
+#include "Mapping.h"
+#include "compression.h"
+#include "PGM.h"
+#include "quantizer.h"
+#include "sampling.h"
+#include "planner.h"
+#include "workspace.h"
+#include "perf_counters.h"
+#include "loader.h"
+
+/*-----------------------------------------------------------------------------+
+|                          HISTOGRAM GENERATION                                |
++-----------------------------------------------------------------------------*/
+static Histogram* histoGen(size_t length, unsigned long long totalCount)
+{
+    Histogram *hist = createEmptyHistogram(length);
+    if(!hist)
+        return NULL;
+
+    // Distribute occurences uniformly with excess on first slot
+    unsigned long long perBin = totalCount / length;
+    hist->count[0] = totalCount - (perBin * length);
+    for(size_t i=0; i<length; i++)
+        hist->count[i] += perBin;
+
+    // Perturb the distribution
+    // 1. remove randomly from each bin
+    unsigned long long excess = 0, rem;
+    for(size_t i=0; i<length; i++)
+    {
+        rem = rand() % hist->count[i];
+        hist->count[i] -= rem;
+        excess += rem;
+    }
+    fprintf(stderr, "Excess: %llu\n", excess); // TODO
+
+    // 2. redistribute excess as uniformly as possible
+    perBin = excess / length;
+    for(size_t i=0; i<length; i++)
+        hist->count[i] += perBin;
+    excess = excess - (perBin * length);
+
+    while(excess-- > 0)
+            hist->count[rand() % length] += 1;
+
+    return hist;
+}
+
+
+
+/*-----------------------------------------------------------------------------+
+|                              COARSE-TO-FINE                                  |
++-----------------------------------------------------------------------------*/
+/***********************************************************************
+ * Compare the coarse-to-fine solver with the exact one on a generated
+ * histogram: time and error of each (the exact solver is skipped on
+ * histograms longer than `maxExactLength`). Prints one CSV record per
+ * window.
+ *
+ * PARAMETERS
+ * length          The length of the histogram
+ * nLevels         The number of levels for the compression
+ * maxExactLength  Longest histogram solved with the exact solver
+ *
+ * RETURN
+ * 0            If no error
+ * non-0        Otherwise
+ ***********************************************************************/
+static int coarseToFineExperiment(size_t length, size_t nLevels,
+                                  size_t maxExactLength)
+{
+    static const size_t coarseLength = 256;
+    Histogram *hist = histoGen(length, 1000ULL * length);
+    if(!hist)
+        return -1;
+
+    double exactTime = 0, exactError = -1;
+    if(length <= maxExactLength)
+    {
+        clock_t start = clock();
+        Mapping *exact = computeMappingExact(hist, nLevels);
+        exactTime = ((double) (clock() - start)) / CLOCKS_PER_SEC;
+        if(!exact)
+        {
+            freeHistogram(hist);
+            return -1;
+        }
+        exactError = computeError(exact, hist);
+        freeMapping(exact);
+    }
+
+    size_t factor = length / coarseLength;
+    size_t windows[] = {0, factor / 2, factor, 2 * factor};
+    for(size_t w=0; w<sizeof(windows)/sizeof(windows[0]); w++)
+    {
+        clock_t start = clock();
+        Mapping *mapping = computeMappingCoarseToFine(hist, nLevels,
+                                                      coarseLength,
+                                                      windows[w]);
+        double time = ((double) (clock() - start)) / CLOCKS_PER_SEC;
+        if(!mapping)
+        {
+            freeHistogram(hist);
+            return -1;
+        }
+        double error = computeError(mapping, hist);
+        freeMapping(mapping);
+
+        printf("%zu,%zu,%zu,%zu,%g,%g,%.0f,%.0f,%g\n", length, nLevels,
+               coarseLength, windows[w], exactTime, time, exactError, error,
+               exactError > 0 ? (error - exactError) / exactError : 0.);
+    }
+
+    freeHistogram(hist);
+    return 0;
+}
+
+
+
+/***********************************************************************
+ * Time of the equal-population solver on a generated histogram, and its
+ * error relative to the exact solver (when the histogram is not longer
+ * than `maxExactLength`). Prints one CSV record.
+ *
+ * PARAMETERS
+ * length          The length of the histogram
+ * nLevels         The number of levels for the compression
+ * maxExactLength  Longest histogram solved with the exact solver
+ *
+ * RETURN
+ * 0            If no error
+ * non-0        Otherwise
+ ***********************************************************************/
+static int equalPopulationExperiment(size_t length, size_t nLevels,
+                                     size_t maxExactLength)
+{
+    Histogram *hist = histoGen(length, 1000ULL * length);
+    if(!hist)
+        return -1;
+
+    clock_t start = clock();
+    Mapping *mapping = computeMappingEqualPopulation(hist, nLevels);
+    double time = ((double) (clock() - start)) / CLOCKS_PER_SEC;
+    Mapping *exact = length <= maxExactLength
+                   ? computeMappingExact(hist, nLevels) : NULL;
+
+    int status = -1;
+    if(mapping && (exact || length > maxExactLength))
+    {
+        double error = computeError(mapping, hist);
+        double exactError = exact ? computeError(exact, hist) : -1;
+        printf("%zu,%zu,%g,%.0f,%.0f,%g\n", length, nLevels, time, exactError,
+               error, exactError > 0 ? (error - exactError) / exactError : 0.);
+        status = 0;
+    }
+
+    freeMapping(mapping);
+    freeMapping(exact);
+    freeHistogram(hist);
+    return status;
+}
+
+
+
+/***********************************************************************
+ * Quality of the anytime solver for several time budgets on a generated
+ * histogram, relative to the exact solver (when the histogram is not
+ * longer than `maxExactLength`). Prints one CSV record per budget.
+ *
+ * PARAMETERS
+ * length          The length of the histogram
+ * nLevels         The number of levels for the compression
+ * maxExactLength  Longest histogram solved with the exact solver
+ *
+ * RETURN
+ * 0            If no error
+ * non-0        Otherwise
+ ***********************************************************************/
+static int anytimeExperiment(size_t length, size_t nLevels,
+                             size_t maxExactLength)
+{
+    static const double budgets[] = {0., 1e-4, 1e-3, 1e-2, 1e-1};
+    Histogram *hist = histoGen(length, 1000ULL * length);
+    if(!hist)
+        return -1;
+
+    Mapping *exact = length <= maxExactLength
+                   ? computeMappingExact(hist, nLevels) : NULL;
+    double exactError = exact ? computeError(exact, hist) : -1;
+    freeMapping(exact);
+
+    int status = 0;
+    for(size_t b=0; b<sizeof(budgets)/sizeof(budgets[0]) && status == 0; b++)
+    {
+        double error = 0;
+        bool optimal = false;
+        clock_t start = clock();
+        Mapping *mapping = computeMappingAnytime(hist, nLevels, budgets[b],
+                                                 &error, &optimal);
+        double time = ((double) (clock() - start)) / CLOCKS_PER_SEC;
+        status = mapping ? 0 : -1;
+        freeMapping(mapping);
+
+        if(status == 0)
+            printf("%zu,%zu,%g,%g,%.0f,%.0f,%g,%d\n", length, nLevels,
+                   budgets[b], time, exactError, error,
+                   exactError > 0 ? (error - exactError) / exactError : 0.,
+                   optimal);
+    }
+
+    freeHistogram(hist);
+    return status;
+}
+
+
+
+/*-----------------------------------------------------------------------------+
+|                              SOLVER WORKSPACE                                |
++-----------------------------------------------------------------------------*/
+/***********************************************************************
+ * Batch throughput of a solver with and without a SolverWorkspace:
+ * `count` generated histograms are solved and the error of each mapping
+ * is computed, first with fresh allocations at every call
+ * (`computeMappingWithPlan`, `computeError`), then in one reused
+ * workspace. Prints one CSV record.
+ *
+ * PARAMETERS
+ * length      The length of the histograms
+ * nLevels     The number of levels for the compression
+ * solver      The solver
+ * count       The number of histograms
+ *
+ * RETURN
+ * 0            If no error
+ * non-0        Otherwise
+ ***********************************************************************/
+static int workspaceExperiment(size_t length, size_t nLevels, Solver solver,
+                               size_t count)
+{
+    static const char *names[] = {"equal-population", "coarse-to-fine",
+                                  "exact"};
+    Plan plan = {solver, 256, length / 256, 1, false, 0, 0,
+                 {NORM_L2, NULL, 0}};
+    Histogram **hists = calloc(count, sizeof(Histogram*));
+    SolverWorkspace *workspace = createSolverWorkspace(length, nLevels);
+    int status = hists && workspace ? 0 : -1;
+    for(size_t h=0; h<count && status == 0; h++)
+        status = (hists[h] = histoGen(length, 100ULL * length)) ? 0 : -1;
+
+    double mallocError = 0, workspaceErr = 0;
+    clock_t start = clock();
+    for(size_t h=0; h<count && status == 0; h++)
+    {
+        Mapping *mapping = computeMappingWithPlan(hists[h], nLevels, &plan);
+        status = mapping ? 0 : -1;
+        mallocError += computeError(mapping, hists[h]);
+        freeMapping(mapping);
+    }
+    double mallocTime = ((double) (clock() - start)) / CLOCKS_PER_SEC;
+
+    start = clock();
+    for(size_t h=0; h<count && status == 0; h++)
+    {
+        status = workspaceSolve(workspace, hists[h], nLevels, &plan)
+               ? 0 : -1;
+        workspaceErr += workspaceError(workspace, hists[h]);
+    }
+    double workspaceTime = ((double) (clock() - start)) / CLOCKS_PER_SEC;
+
+    if(status == 0)
+        printf("%zu,%zu,%s,%zu,%g,%g,%d\n", length, nLevels, names[solver],
+               count, count / mallocTime, count / workspaceTime,
+               mallocError == workspaceErr);
+
+    for(size_t h=0; hists && h<count; h++)
+        freeHistogram(hists[h]);
+    free(hists);
+    freeSolverWorkspace(workspace);
+    return status;
+}
+
+
+
+/*-----------------------------------------------------------------------------+
+|                              8-BIT EXACT SOLVER                              |
++-----------------------------------------------------------------------------*/
+/***********************************************************************
+ * Latency of the exact solver specialised for 8-bit histograms
+ * (`exactMapping8`, into caller arrays) and of the generic one
+ * (`computeMappingExact`) on `count` generated histograms of 256 values.
+ * Prints one CSV record.
+ *
+ * PARAMETERS
+ * nLevels     The number of levels for the compression
+ * count       The number of histograms
+ *
+ * RETURN
+ * 0            If no error
+ * non-0        Otherwise
+ ***********************************************************************/
+static int exact8Experiment(size_t nLevels, size_t count)
+{
+    Histogram **hists = calloc(count, sizeof(Histogram*));
+    int status = hists ? 0 : -1;
+    for(size_t h=0; h<count && status == 0; h++)
+        status = (hists[h] = histoGen(EXACT8_LENGTH,
+                                      100ULL * EXACT8_LENGTH)) ? 0 : -1;
+
+    double genericError = 0, specialisedError = 0;
+    clock_t start = clock();
+    for(size_t h=0; h<count && status == 0; h++)
+    {
+        Mapping *mapping = computeMappingExact(hists[h], nLevels);
+        status = mapping ? 0 : -1;
+        genericError += computeError(mapping, hists[h]);
+        freeMapping(mapping);
+    }
+    double genericTime = ((double) (clock() - start)) / CLOCKS_PER_SEC;
+
+    size_t thresholds[EXACT8_MAX_LEVELS];
+    uint16_t levels[EXACT8_MAX_LEVELS];
+    start = clock();
+    for(size_t h=0; h<count && status == 0; h++)
+    {
+        double error = exactMapping8(hists[h], nLevels, thresholds, levels,
+                                     NULL);
+        status = error != DBL_MAX ? 0 : -1;
+        specialisedError += error;
+    }
+    double specialisedTime = ((double) (clock() - start)) / CLOCKS_PER_SEC;
+
+    if(status == 0)
+        printf("%zu,%zu,%g,%g,%d\n", nLevels, count,
+               genericTime / count * 1e6, specialisedTime / count * 1e6,
+               genericError == specialisedError);
+
+    for(size_t h=0; hists && h<count; h++)
+        freeHistogram(hists[h]);
+    free(hists);
+    return status;
+}
+
+
+
+/*-----------------------------------------------------------------------------+
+|                             SAMPLED HISTOGRAMS                               |
++-----------------------------------------------------------------------------*/
+// Target of the sample rate given by `samplingRateForConfidence`
+#define SAMPLING_QUANTILE_ERROR 0.01
+#define SAMPLING_CONFIDENCE 0.99
+
+/* The mapping of the compressor with its default options, NULL if error */
+static Mapping* defaultMapping(const Histogram *histogram, size_t nLevels)
+{
+    Mapping *mapping = createUninitializedMapping(nLevels);
+    if(mapping && quantizerMapping(histogram, mapping) != 0)
+    {
+        freeMapping(mapping);
+        return NULL;
+    }
+    return mapping;
+}
+
+/***********************************************************************
+ * Compare, for several sample rates, the cost of building a sampled
+ * histogram and the quality of the resulting mapping with the full
+ * histogram. The mappings are computed as the compressor does by default
+ * (see `quantizerMapping`) and their error is measured on the FULL
+ * histogram. The last rate is the one given by `samplingRateForConfidence`
+ * for every quantile within SAMPLING_QUANTILE_ERROR with probability
+ * SAMPLING_CONFIDENCE. Prints one CSV record per rate.
+ *
+ * PARAMETERS
+ * filename    A grayscale image
+ * nLevels     The number of levels for the compression
+ *
+ * RETURN
+ * 0            If no error
+ * non-0        Otherwise
+ ***********************************************************************/
+static int samplingExperiment(const char* filename, size_t nLevels)
+{
+    double rates[] = {1., 0.25, 1./16, 1./64, 1./256, 1./1024, 1.};
+    size_t numRates = sizeof(rates)/sizeof(rates[0]);
+
+    clock_t start = clock();
+    PGM* image = createImageFromFile(filename);
+    double decodeTime = ((double) (clock() - start)) / CLOCKS_PER_SEC;
+    if(!image || image->channels != 1)
+    {
+        freeImage(image);
+        return -1;
+    }
+    rates[numRates-1] = samplingRateForConfidence(image->width * image->height,
+                                                  SAMPLING_QUANTILE_ERROR,
+                                                  SAMPLING_CONFIDENCE);
+
+    PixelBuffer src = {image->raster, image->width, 1, image->height,
+                       image->width * image->bytesPerSample,
+                       image->bytesPerSample == 1 ? 8 : 16};
+    Histogram *full = createEmptyHistogram(image->maxValue+1);
+    Histogram *sampled = createEmptyHistogram(image->maxValue+1);
+    Mapping *reference = NULL;
+    int status = -1;
+    if(!full || !sampled || quantizerHistogram(&src, &full) != 0
+       || !(reference = defaultMapping(full, nLevels)))
+        goto cleanup;
+
+    double referenceError = computeError(reference, full);
+
+    for(size_t r=0; r<numRates; r++)
+    {
+        Sampling sampling = samplingFromRate(rates[r], SAMPLING_RANDOM);
+
+        start = clock();
+        if(sampledHistogram(&src, &sampled, sampling) != 0)
+            goto cleanup;
+        double histTime = ((double) (clock() - start)) / CLOCKS_PER_SEC;
+
+        start = clock();
+        Histogram *fromFile = sampledHistogramFromFile(filename, sampling);
+        double fileTime = ((double) (clock() - start)) / CLOCKS_PER_SEC;
+        freeHistogram(fromFile);
+
+        Mapping *mapping = defaultMapping(sampled, nLevels);
+        if(!mapping)
+            goto cleanup;
+        double error = computeError(mapping, full);
+        freeMapping(mapping);
+
+        printf("%s,%zu,%g,%zu,%zu,%g,%g,%g,%.0f,%.0f,%g\n", filename,
+               nLevels, rates[r], sampling.rowStep, sampling.colStep,
+               decodeTime, histTime, fileTime, referenceError, error,
+               referenceError > 0 ? (error - referenceError) / referenceError
+                                  : 0.);
+    }
+    status = 0;
+
+cleanup:
+    freeMapping(reference);
+    freeHistogram(full);
+    freeHistogram(sampled);
+    freeImage(image);
+    return status;
+}
+
+
+
+/*-----------------------------------------------------------------------------+
+|                            HARDWARE COUNTERS                                 |
++-----------------------------------------------------------------------------*/
+/* Print one CSV record of the phase experiment */
+static void printPhase(const char* filename, size_t nLevels, size_t run,
+                       const char* phase, const PerfSample *sample)
+{
+    printf("%s,%zu,%zu,%s,%g,", filename, nLevels, run, phase,
+           sample->seconds);
+    printCounters(stdout, sample);
+    printf("\n");
+}
+
+/***********************************************************************
+ * Time (and count, if `counters` is not NULL) each phase of the
+ * compression of an image, as in the compressor: the loading
+ * (`createImageFromFile`), the histogram (`image2histogram`), both at
+ * once in parallel (`loadImage`, whose histogram is checked against the
+ * serial one), the mapping (`computeMappingWithPlan`, with the plan the
+ * compressor chooses by default) and the remap
+ * through the lookup table (`applyMapping`, into a separate buffer so
+ * that every run remaps the same pixels). Prints one CSV record per
+ * phase and run.
+ *
+ * PARAMETERS
+ * filename    A grayscale image
+ * nLevels     The number of levels for the compression
+ * runs        The number of runs
+ * counters    The hardware counters, NULL to only measure the time
+ *
+ * RETURN
+ * 0            If no error
+ * non-0        Otherwise
+ ***********************************************************************/
+static int phaseExperiment(const char* filename, size_t nLevels, size_t runs,
+                           PerfCounters *counters)
+{
+    PGM* image = createImageFromFile(filename);
+    if(!image || image->channels != 1)
+    {
+        freeImage(image);
+        return -1;
+    }
+
+    size_t rowBytes = image->width * image->bytesPerSample;
+    PixelBuffer src = {image->raster, image->width, 1, image->height,
+                       rowBytes, image->bytesPerSample == 1 ? 8 : 16};
+    PixelBuffer dst = src;
+    dst.pixels = malloc(rowBytes * image->height);
+    Histogram *hist = createEmptyHistogram(image->maxValue+1);
+    int status = dst.pixels && hist ? 0 : -1;
+
+    for(size_t run=0; run<runs && status == 0; run++)
+    {
+        PerfSample sample;
+        startCounters(counters, &sample);
+        PGM *loaded = createImageFromFile(filename);
+        stopCounters(counters, &sample);
+        freeImage(loaded);
+        if(!loaded)
+        {
+            status = -1;
+            break;
+        }
+        printPhase(filename, nLevels, run, "createImageFromFile", &sample);
+
+        startCounters(counters, &sample);
+        status = quantizerHistogram(&src, &hist);
+        stopCounters(counters, &sample);
+        if(status != 0)
+            break;
+        printPhase(filename, nLevels, run, "image2histogram", &sample);
+
+        // Parallel decoding and histogram in one pass: same histogram
+        Histogram *loadedHists[3];
+        startCounters(counters, &sample);
+        loaded = loadImage(filename, 0, loadedHists);
+        stopCounters(counters, &sample);
+        status = !loaded || memcmp(loadedHists[0]->count, hist->count,
+                                   hist->length * sizeof(unsigned long long));
+        freeHistogram(loadedHists[0]);
+        freeImage(loaded);
+        if(status != 0)
+            break;
+        printPhase(filename, nLevels, run, "loadImage", &sample);
+
+        Plan plan;
+        PlannerConstraints constraints = {OPTIMALITY_NEAR_OPTIMAL, 0, 0, true,
+                                          {NORM_L2, NULL, 0}};
+        PlanInput input = planInput(&hist, 1, nLevels,
+                                    image->width * image->height,
+                                    image->bytesPerSample, false);
+        planCompression(&input, &constraints, &plan);
+
+        startCounters(counters, &sample);
+        Mapping *mapping = computeMappingWithPlan(hist, nLevels, &plan);
+        stopCounters(counters, &sample);
+        uint16_t *lookUpTable = mapping ? mapping2Lookup(mapping,
+                                                         image->maxValue)
+                                        : NULL;
+        freeMapping(mapping);
+        if(!lookUpTable)
+        {
+            status = -1;
+            break;
+        }
+        printPhase(filename, nLevels, run, "computeMappingWithPlan", &sample);
+
+        const uint16_t *lookUpTables[1] = {lookUpTable};
+        startCounters(counters, &sample);
+        status = quantizerRemap(&src, &dst, lookUpTables, hist->length, NULL);
+        stopCounters(counters, &sample);
+        free(lookUpTable);
+        if(status == 0)
+            printPhase(filename, nLevels, run, "applyMapping", &sample);
+    }
+
+    free(dst.pixels);
+    freeHistogram(hist);
+    freeImage(image);
+    return status;
+}
+
+
+
+/*-----------------------------------------------------------------------------+
+|                                  MAIN                                        |
++-----------------------------------------------------------------------------*/
+int main(int argc, char** argv)
+{
+    srand(time(NULL));//Use an integer seed to get a fix sequence
+
+    /*
+     * Do your experiment here. You can use `histoGen` to generate histograms
+     */
+    if(argc == 1)
+    {
+        printf("length,k,coarse,window,exact_s,c2f_s,exact_error,c2f_error,"
+               "relative_diff\n");
+        size_t lengths[] = {1024, 4096, 65536};
+        for(size_t l=0; l<sizeof(lengths)/sizeof(lengths[0]); l++)
+            for(size_t k=2; k<=16; k*=2)
+                if(coarseToFineExperiment(lengths[l], k, 4096) != 0)
+                    fprintf(stderr, "Error while benchmarking length %zu\n",
+                            lengths[l]);
+
+        printf("length,k,equal_population_s,exact_error,"
+               "equal_population_error,relative_diff\n");
+        for(size_t l=0; l<sizeof(lengths)/sizeof(lengths[0]); l++)
+            for(size_t k=2; k<=16; k*=2)
+                if(equalPopulationExperiment(lengths[l], k, 4096) != 0)
+                    fprintf(stderr, "Error while benchmarking length %zu\n",
+                            lengths[l]);
+
+        printf("length,k,budget_s,anytime_s,exact_error,anytime_error,"
+               "relative_diff,optimal\n");
+        for(size_t l=0; l<sizeof(lengths)/sizeof(lengths[0]); l++)
+            for(size_t k=2; k<=16; k*=4)
+                if(anytimeExperiment(lengths[l], k, 4096) != 0)
+                    fprintf(stderr, "Error while benchmarking length %zu\n",
+                            lengths[l]);
+
+        printf("length,k,solver,histograms,malloc_per_s,workspace_per_s,"
+               "same_errors\n");
+        for(Solver solver=SOLVER_EQUAL_POPULATION; solver<=SOLVER_EXACT;
+            solver++)
+            for(size_t k=2; k<=16; k*=4)
+                if(workspaceExperiment(256, k, solver, 2000) != 0)
+                    fprintf(stderr, "Error while benchmarking the "
+                                    "workspace\n");
+
+        printf("k,histograms,generic_us,exact8_us,same_errors\n");
+        for(size_t k=2; k<=EXACT8_MAX_LEVELS; k*=2)
+            if(exact8Experiment(k, 200) != 0)
+                fprintf(stderr, "Error while benchmarking the 8-bit exact "
+                                "solver\n");
+    }
+
+    // -c: hardware counters in the records of the phases
+    int first = 1;
+    PerfCounters *counters = NULL;
+    if(argc > 1 && strcmp(argv[1], "-c") == 0)
+    {
+        first = 2;
+        counters = createPerfCounters();
+        if(availableCounters(counters) < NUM_COUNTERS)
+            fprintf(stderr, "Only %d of %d hardware counters available\n",
+                    availableCounters(counters), NUM_COUNTERS);
+    }
+
+    if(argc > first)
+        printf("image,k,rate,rowStep,colStep,decode_s,sampled_hist_s,"
+               "sampled_file_s,full_error,sampled_error,relative_diff\n");
+    for(int i=first; i<argc; i++)
+        if(samplingExperiment(argv[i], 4) != 0)
+            fprintf(stderr, "Error while benchmarking '%s'\n", argv[i]);
+
+    if(argc > first)
+    {
+        printf("image,k,run,phase,seconds,");
+        printCountersHeader(stdout);
+        printf("\n");
+    }
+    for(int i=first; i<argc; i++)
+        if(phaseExperiment(argv[i], 4, 3, counters) != 0)
+            fprintf(stderr, "Error while benchmarking '%s'\n", argv[i]);
+    freePerfCounters(counters);
+
+
+    return EXIT_SUCCESS;
+}
+
@@ -0,0 +1,167 @@
+/***********************************************************************
+ * Exact mapping specialised for 8-bit histograms (n = 256, k <= 64).
+ *
+ * Same dynamic program as `exactMapping` (squared error, unweighted),
+ * with the sizes known at compile time. The tables of the k layers are
+ * taken at once from an arena (or the heap), not from the stack: about
+ * 2.5 KiB per level, 165 KiB at 64 levels, more than the stack of some
+ * threads. The program goes column by
+ * column: for each end p, the errors E(q, p) of all the intervals ending
+ * at p are computed once in a small (L1-resident) column, then every
+ * layer i takes
+ *     value[i][p] = min_q value[i-1][q] + E(q, p)
+ * with branch-free loops over 4 independent accumulators, which the
+ * compiler unrolls and vectorises.
+ *
+ * The prefix sums are integers, and so are the terms of the errors (the
+ * levels are integers): up to EXACT8_MAX_PIXELS (2^52 / 255^2) pixels
+ * they are all exact in doubles, and so are the errors and their sums;
+ * larger histograms are rejected: the error is the one of
+ * `exactMapping` and so are the thresholds, but for the place of a
+ * threshold within a run of empty bins (which changes no pixel).
+ ***********************************************************************/
+#include <stdlib.h>
+#include <stdint.h>
+#include <float.h>
+#include <math.h>
+
+#include "compression.h"
+
+/*
+ * Exact solver on histograms of LENGTH values: fills the k-1 boundaries
+ * of the optimal mapping on k levels (k >= 1) and returns its error
+ * (DBL_MAX if the tables cannot be allocated from `arena`).
+ */
+#define DEFINE_EXACT_SOLVER(NAME, LENGTH)                                    \
+static double NAME(const unsigned long long *count, size_t k,                \
+                   size_t *boundaries, double *c, double *s1, double *s2,    \
+                   Arena *arena)                                             \
+{                                                                            \
+    /* value[k][LENGTH+1], column, sums, then choice[k][LENGTH+1] */         \
+    double *tables = arenaAlloc(arena, (k + 2) * (LENGTH+1) * sizeof(double) \
+                                       + k * (LENGTH+1) * sizeof(uint16_t)); \
+    if(!tables)                                                              \
+        return DBL_MAX;                                                      \
+    double (*value)[LENGTH+1] = (double (*)[LENGTH+1])tables;                \
+    double *column = tables + k * (LENGTH+1), *sums = column + (LENGTH+1);   \
+    uint16_t (*choice)[LENGTH+1] =                                           \
+        (uint16_t (*)[LENGTH+1])(sums + (LENGTH+1));                         \
+                                                                             \
+    c[0] = s1[0] = s2[0] = 0;                                                \
+    for(size_t v=0; v<LENGTH; v++)                                           \
+    {                                                                        \
+        double n = (double)count[v];                                         \
+        c[v+1] = c[v] + n;                                                   \
+        s1[v+1] = s1[v] + n * v;                                             \
+        s2[v+1] = s2[v] + n * v * v;                                         \
+    }                                                                        \
+                                                                             \
+    for(size_t p=1; p<=LENGTH; p++)                                          \
+    {                                                                        \
+        /* Layer i: i+1 intervals, the last one [q, p) with q >= i; the */   \
+        /* last layer only ends at LENGTH */                                 \
+        size_t layers = p == LENGTH ? k : (k-1 < p ? k-1 : p);               \
+                                                                             \
+        /* E(q, p): error of [q, p) on its rounded mean (0 if empty); */     \
+        /* the mean is not negative, so truncation rounds it down */         \
+        for(size_t q=0; q<(layers > 1 ? p : 1); q++)                         \
+        {                                                                    \
+            double n = c[p] - c[q], t1 = s1[p] - s1[q];                      \
+            double g = (double)(int64_t)(t1 / (n > 0 ? n : 1) + 0.5);        \
+            column[q] = (s2[p] - s2[q]) - 2 * g * t1 + g * g * n;            \
+        }                                                                    \
+        value[0][p] = column[0];                                             \
+                                                                             \
+        for(size_t i=1; i<layers; i++)                                       \
+        {                                                                    \
+            const double *previous = value[i-1];                             \
+            size_t q = i;                                                    \
+            double m0 = previous[q] + column[q], m1 = m0, m2 = m0, m3 = m0;  \
+            for(; q+4<=p; q+=4)                                              \
+            {                                                                \
+                sums[q] = previous[q] + column[q];                           \
+                sums[q+1] = previous[q+1] + column[q+1];                     \
+                sums[q+2] = previous[q+2] + column[q+2];                     \
+                sums[q+3] = previous[q+3] + column[q+3];                     \
+                m0 = sums[q] < m0 ? sums[q] : m0;                            \
+                m1 = sums[q+1] < m1 ? sums[q+1] : m1;                        \
+                m2 = sums[q+2] < m2 ? sums[q+2] : m2;                        \
+                m3 = sums[q+3] < m3 ? sums[q+3] : m3;                        \
+            }                                                                \
+            for(; q<p; q++)                                                  \
+            {                                                                \
+                sums[q] = previous[q] + column[q];                           \
+                m0 = sums[q] < m0 ? sums[q] : m0;                            \
+            }                                                                \
+            double best = m0 < m1 ? m0 : m1;                                 \
+            best = m2 < best ? m2 : best;                                    \
+            best = m3 < best ? m3 : best;                                    \
+                                                                             \
+            /* First boundary reaching the minimum */                        \
+            size_t bestQ = i;                                                \
+            while(sums[bestQ] != best)                                       \
+                bestQ++;                                                     \
+            value[i][p] = best;                                              \
+            choice[i][p] = (uint16_t)bestQ;                                  \
+        }                                                                    \
+    }                                                                        \
+                                                                             \
+    size_t p = LENGTH;                                                       \
+    for(size_t i=k-1; i>0; i--)                                              \
+        p = boundaries[i-1] = choice[i][p];                                  \
+    double error = value[k-1][LENGTH];                                       \
+    arenaFree(arena, tables);                                                \
+    return error;                                                            \
+}
+
+DEFINE_EXACT_SOLVER(solveExact256, EXACT8_LENGTH)
+
+double exactMapping8(const Histogram *histogram, size_t nLevels,
+                     size_t *thresholds, uint16_t *levels, Arena *arena)
+{
+    if(!histogram || histogram->length != EXACT8_LENGTH || nLevels == 0
+       || nLevels > EXACT8_MAX_LEVELS || !thresholds || !levels)
+        return DBL_MAX;
+
+    // Beyond, the sums would be rounded
+    unsigned long long pixels = 0;
+    for(size_t v=0; v<EXACT8_LENGTH; v++)
+        pixels += histogram->count[v];
+    if(pixels > EXACT8_MAX_PIXELS)
+        return DBL_MAX;
+
+    size_t boundaries[EXACT8_MAX_LEVELS];
+    double c[EXACT8_LENGTH+1], s1[EXACT8_LENGTH+1], s2[EXACT8_LENGTH+1];
+    double error = solveExact256(histogram->count, nLevels, boundaries, c,
+                                 s1, s2, arena);
+    if(error == DBL_MAX)
+        return DBL_MAX;
+
+    // Levels: rounded means, the middle of empty intervals
+    for(size_t i=0, begin=0; i<nLevels; i++)
+    {
+        size_t end = i+1 < nLevels ? boundaries[i] : EXACT8_LENGTH;
+        double n = c[end] - c[begin];
+        thresholds[i] = end;
+        levels[i] = (uint16_t)(n > 0 ? floor((s1[end] - s1[begin]) / n + 0.5)
+                                     : (begin + end - 1) / 2);
+        begin = end;
+    }
+    return error;
+}
+
+Mapping* computeMappingExact8(const Histogram *histogram, size_t nLevels)
+{
+    if(!histogram || histogram->length != EXACT8_LENGTH || nLevels == 0
+       || nLevels > EXACT8_MAX_LEVELS)
+        return NULL;
+
+    Mapping *mapping = createUninitializedMapping(nLevels);
+    if(mapping && exactMapping8(histogram, nLevels, mapping->thresholds,
+                                mapping->levels, NULL) == DBL_MAX)
+    {
+        freeMapping(mapping);
+        return NULL;
+    }
+    return mapping;
+}
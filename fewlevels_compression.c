@@ -0,0 +1,165 @@
+/***********************************************************************
+ * Exact mappings on 2 or 3 levels (binarisation and three-level
+ * quantization), without the O(k d^2) dynamic program.
+ *
+ * With E(a, b) the error of the bins [a, b) (see `intervalError`):
+ * - k = 2: the threshold t minimizing E(0, t) + E(t, d) is found by a
+ *   single sweep over the prefix sums, in O(d) (Otsu's method, with the
+ *   error of the rounded levels instead of the between-class variance).
+ * - k = 3: with F(b) = min_a E(0, a) + E(a, b) the best split of [0, b)
+ *   in two, the error is min_b F(b) + E(b, d). E satisfies the quadrangle
+ *   inequality, so the (first) best a is a non-decreasing function of b:
+ *   F is computed for every b by divide and conquer on b, each half
+ *   searching a on its side of the split of the middle b only, in
+ *   O(d log d) interval errors.
+ * Both run on the d non-empty bins, as `exactMapping`.
+ ***********************************************************************/
+#include <stdlib.h>
+#include <float.h>
+
+#include "compression.h"
+
+/***********************************************************************
+ * F(b) and its best split for every b in [bLo, bHi], the best splits
+ * being in [aLo, aHi]. `head[a]` holds E(0, a).
+ ***********************************************************************/
+static void bestSplits(const CumulativeHistogram *cumulative,
+                       const double *head, size_t bLo, size_t bHi,
+                       size_t aLo, size_t aHi, double *best, size_t *split)
+{
+    while(bLo <= bHi)
+    {
+        size_t b = bLo + (bHi - bLo) / 2;
+        size_t last = aHi < b ? aHi : b - 1;
+        double value = DBL_MAX;
+        size_t arg = aLo;
+        for(size_t a=aLo; a<=last; a++)
+        {
+            double error = head[a] + intervalError(cumulative, a, b, NULL);
+            if(error < value)
+            {
+                value = error;
+                arg = a;
+            }
+        }
+        best[b] = value;
+        split[b] = arg;
+
+        // Left half recursively, right half in the loop
+        if(b > bLo)
+            bestSplits(cumulative, head, bLo, b - 1, aLo, arg, best, split);
+        bLo = b + 1;
+        aLo = arg;
+    }
+}
+
+/***********************************************************************
+ * Best boundaries of k <= FEW_LEVELS_MAX intervals (k <= length).
+ *
+ * RETURN
+ * error        The error of the boundaries, DBL_MAX in case of error
+ ***********************************************************************/
+static double solveFewLevels(const CumulativeHistogram *cumulative,
+                             size_t k, size_t *boundaries, Arena *arena)
+{
+    size_t d = cumulative->length;
+    if(k == 1)
+        return intervalError(cumulative, 0, d, NULL);
+
+    if(k == 2)
+    {
+        double bestError = DBL_MAX;
+        for(size_t t=1; t<d; t++)
+        {
+            double error = intervalError(cumulative, 0, t, NULL)
+                         + intervalError(cumulative, t, d, NULL);
+            if(error < bestError)
+            {
+                bestError = error;
+                boundaries[0] = t;
+            }
+        }
+        return bestError;
+    }
+
+    double *head = arenaAlloc(arena, (d+1) * sizeof(double));
+    double *best = arenaAlloc(arena, (d+1) * sizeof(double));
+    size_t *split = arenaAlloc(arena, (d+1) * sizeof(size_t));
+    double bestError = DBL_MAX;
+    if(head && best && split)
+    {
+        for(size_t a=1; a<d; a++)
+            head[a] = intervalError(cumulative, 0, a, NULL);
+        bestSplits(cumulative, head, 2, d-1, 1, d-2, best, split);
+
+        for(size_t b=2; b<d; b++)
+        {
+            double error = best[b] + intervalError(cumulative, b, d, NULL);
+            if(error < bestError)
+            {
+                bestError = error;
+                boundaries[0] = split[b];
+                boundaries[1] = b;
+            }
+        }
+    }
+
+    arenaFree(arena, head);
+    arenaFree(arena, best);
+    arenaFree(arena, split);
+    return bestError;
+}
+
+/* Solve on min(nLevels, length) levels, as `exactMapping` */
+static Mapping* solveMapping(const CumulativeHistogram *cumulative,
+                             size_t nLevels, Arena *arena)
+{
+    size_t n = cumulative->length;
+    size_t k = nLevels < n ? nLevels : n;
+    size_t boundaries[FEW_LEVELS_MAX];
+    if(solveFewLevels(cumulative, k, boundaries, arena) == DBL_MAX)
+        return NULL;
+    return createMappingFromBoundariesInArena(arena, cumulative, boundaries,
+                                              k, nLevels);
+}
+
+Mapping* fewLevelsMapping(const CumulativeHistogram *cumulative,
+                          size_t nLevels, Arena *arena)
+{
+    if(!cumulative || cumulative->length == 0 || nLevels == 0
+       || nLevels > FEW_LEVELS_MAX)
+        return NULL;
+
+    size_t n = cumulative->length, distinct = 0;
+    for(size_t i=0; i<n; i++)
+        distinct += cumulative->count[i+1] != cumulative->count[i];
+
+    // Nothing to compact
+    if(distinct == 0 || distinct == n || cumulative->values)
+        return solveMapping(cumulative, nLevels, arena);
+
+    CumulativeHistogram *compact = createCompactCumulative(cumulative,
+                                                           distinct, arena);
+    Mapping *mapping = compact ? solveMapping(compact, nLevels, arena) : NULL;
+
+    // Back from compact indices to gray values
+    if(mapping)
+        for(size_t i=0; i<mapping->nLevels; i++)
+            mapping->thresholds[i] = mapping->thresholds[i] < distinct
+                                   ? compact->values[mapping->thresholds[i]]
+                                   : n;
+
+    freeCumulativeHistogramInArena(arena, compact);
+    return mapping;
+}
+
+Mapping* computeMappingFewLevels(const Histogram *histogram, size_t nLevels)
+{
+    CumulativeHistogram *cumulative = createCumulativeHistogram(histogram);
+    if(!cumulative)
+        return NULL;
+
+    Mapping *mapping = fewLevelsMapping(cumulative, nLevels, NULL);
+    freeCumulativeHistogram(cumulative);
+    return mapping;
+}
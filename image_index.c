@@ -0,0 +1,268 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "image_index.h"
+
+// Version of the index file format
+#define INDEX_VERSION 1
+// Longest name read from an index file
+#define MAX_NAME_LENGTH 4096
+
+/* Path of a file of a directory, to be free with `free` (NULL if error) */
+static char* joinPath(const char *directory, const char *name)
+{
+    size_t size = strlen(directory) + strlen(name) + 2;
+    char *path = malloc(size);
+    if(path)
+        snprintf(path, size, "%s/%s", directory, name);
+    return path;
+}
+
+static char* copyName(const char *name)
+{
+    char *copy = malloc(strlen(name) + 1);
+    if(copy)
+        strcpy(copy, name);
+    return copy;
+}
+
+static int compareEntryNames(const void *a, const void *b)
+{
+    return strcmp(((const IndexEntry*)a)->name, ((const IndexEntry*)b)->name);
+}
+
+static int compareEntrySizes(const void *a, const void *b)
+{
+    size_t sizeA = rasterBytes(&((const IndexEntry*)a)->header);
+    size_t sizeB = rasterBytes(&((const IndexEntry*)b)->header);
+    if(sizeA != sizeB)
+        return sizeA > sizeB ? -1 : 1;
+    return compareEntryNames(a, b);
+}
+
+/* Append an entry (taking over its name) */
+static int appendEntry(ImageIndex *index, size_t *capacity, IndexEntry entry)
+{
+    if(index->count == *capacity)
+    {
+        size_t larger = *capacity > 0 ? 2 * *capacity : 64;
+        IndexEntry *entries = realloc(index->entries,
+                                      larger * sizeof(IndexEntry));
+        if(!entries)
+            return -1;
+        index->entries = entries;
+        *capacity = larger;
+    }
+    index->entries[index->count++] = entry;
+    return 0;
+}
+
+/***********************************************************************
+ * Read the saved index of a directory.
+ *
+ * RETURN
+ * index        The saved index, sorted by name (empty if there is none or
+ *              if it is invalid, `*valid` being then set to false)
+ * NULL         In case of error (out of memory)
+ ***********************************************************************/
+static ImageIndex* readSavedIndex(const char *directory, bool *valid)
+{
+    ImageIndex *index = calloc(1, sizeof(ImageIndex));
+    char *path = joinPath(directory, IMAGE_INDEX_NAME);
+    char *name = malloc(MAX_NAME_LENGTH + 2);
+    FILE *file = path ? fopen(path, "r") : NULL;
+    int version = 0;
+    *valid = file && fscanf(file, "PGMINDEX %d", &version) == 1
+             && version == INDEX_VERSION;
+
+    size_t capacity = 0;
+    int status = index && name ? 0 : -1;
+    while(status == 0 && *valid)
+    {
+        int type = 0;
+        unsigned maxValue = 0;
+        IndexEntry entry = {NULL, {0}, 0, 0};
+        PGMHeader *header = &entry.header;
+        if(fscanf(file, "%d %zu %zu %u %ld %lld %lld", &type, &header->width,
+                  &header->height, &maxValue, &header->rasterOffset,
+                  &entry.mtime, &entry.size) != 7)
+            break; // End of the index
+
+        // The name runs to the end of the line
+        size_t length = 0;
+        *valid = fgetc(file) == ' ' && fgets(name, MAX_NAME_LENGTH + 2, file)
+                 && (length = strlen(name)) > 1 && name[length-1] == '\n'
+                 && (type == ASCII || type == BINARY || type == PPM_ASCII
+                     || type == PPM_BINARY)
+                 && maxValue > 0 && maxValue <= UINT16_MAX;
+        if(!*valid)
+            break;
+        name[length-1] = '\0';
+
+        header->type = (PGMType)type;
+        header->channels = type == PPM_ASCII || type == PPM_BINARY ? 3 : 1;
+        header->maxValue = (uint16_t)maxValue;
+        header->bytesPerSample = maxValue <= UINT8_MAX ? 1 : 2;
+        entry.name = copyName(name);
+        status = !entry.name || appendEntry(index, &capacity, entry) != 0;
+        if(status != 0)
+            free(entry.name);
+    }
+
+    if(file)
+        fclose(file);
+    free(path);
+    free(name);
+    if(status != 0)
+    {
+        freeImageIndex(index);
+        return NULL;
+    }
+    if(!*valid)
+    {
+        for(size_t i=0; i<index->count; i++)
+            free(index->entries[i].name);
+        index->count = 0;
+    }
+    if(index->count > 0)
+        qsort(index->entries, index->count, sizeof(IndexEntry),
+              compareEntryNames);
+    return index;
+}
+
+ImageIndex* indexDirectory(const char *directory)
+{
+    DIR *files = directory ? opendir(directory) : NULL;
+    if(!files)
+        return NULL;
+
+    bool valid = false;
+    ImageIndex *saved = readSavedIndex(directory, &valid);
+    ImageIndex *index = calloc(1, sizeof(ImageIndex));
+    size_t capacity = 0, reused = 0;
+    int status = saved && index ? 0 : -1;
+
+    struct dirent *file;
+    while(status == 0 && (file = readdir(files)))
+    {
+        // Neither the index (nor its temporary files) nor the names that
+        // would break a line of the index
+        if(strncmp(file->d_name, IMAGE_INDEX_NAME,
+                   strlen(IMAGE_INDEX_NAME)) == 0
+           || strchr(file->d_name, '\n'))
+            continue;
+
+        char *path = joinPath(directory, file->d_name);
+        struct stat info;
+        if(!path || stat(path, &info) != 0 || !S_ISREG(info.st_mode))
+        {
+            status = path ? 0 : -1;
+            free(path);
+            continue;
+        }
+
+        // Unchanged files keep their saved header, the others are probed
+        IndexEntry entry = {file->d_name, {0}, (long long)info.st_mtime,
+                            (long long)info.st_size};
+        const IndexEntry *old = saved->count == 0 ? NULL
+            : bsearch(&entry, saved->entries, saved->count,
+                      sizeof(IndexEntry), compareEntryNames);
+        bool image = true;
+        if(old && old->mtime == entry.mtime && old->size == entry.size)
+        {
+            entry.header = old->header;
+            reused++;
+        }
+        else
+            image = probeImage(path, &entry.header) == 0;
+        free(path);
+        if(!image)
+            continue;
+
+        entry.name = copyName(file->d_name);
+        status = !entry.name || appendEntry(index, &capacity, entry) != 0;
+        if(status != 0)
+            free(entry.name);
+    }
+    closedir(files);
+
+    if(status == 0 && index->count > 0)
+        qsort(index->entries, index->count, sizeof(IndexEntry),
+              compareEntryNames);
+    if(status == 0)
+        index->modified = !valid || index->count != reused
+                          || saved->count != reused;
+    freeImageIndex(saved);
+    if(status != 0)
+    {
+        freeImageIndex(index);
+        return NULL;
+    }
+    return index;
+}
+
+int saveImageIndex(ImageIndex *index, const char *directory)
+{
+    if(!index || !directory)
+        return -1;
+
+    // Written aside, then renamed over the index
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%ld", (long)getpid());
+    char *path = joinPath(directory, IMAGE_INDEX_NAME);
+    char *temporary = path ? malloc(strlen(path) + strlen(suffix) + 1) : NULL;
+    if(!temporary)
+    {
+        free(path);
+        return -1;
+    }
+    strcat(strcpy(temporary, path), suffix);
+
+    FILE *file = fopen(temporary, "w");
+    int status = !file || fprintf(file, "PGMINDEX %d\n", INDEX_VERSION) < 0;
+    for(size_t i=0; i<index->count && status == 0; i++)
+    {
+        const IndexEntry *entry = &index->entries[i];
+        status = fprintf(file, "%d %zu %zu %u %ld %lld %lld %s\n",
+                         (int)entry->header.type, entry->header.width,
+                         entry->header.height, entry->header.maxValue,
+                         entry->header.rasterOffset, entry->mtime,
+                         entry->size, entry->name) < 0;
+    }
+    if(file && fclose(file) != 0)
+        status = -1;
+    if(status == 0)
+        status = rename(temporary, path) != 0;
+    if(status != 0)
+        remove(temporary);
+    else
+        index->modified = false;
+
+    free(path);
+    free(temporary);
+    return status;
+}
+
+void sortIndexLargestFirst(ImageIndex *index)
+{
+    if(index && index->count > 0)
+        qsort(index->entries, index->count, sizeof(IndexEntry),
+              compareEntrySizes);
+}
+
+void freeImageIndex(ImageIndex *index)
+{
+    if(!index)
+        return;
+    for(size_t i=0; i<index->count; i++)
+        free(index->entries[i].name);
+    free(index->entries);
+    free(index);
+}
@@ -0,0 +1,99 @@
+/***********************************************************************
+ * Index of the images of a directory: the header of each image (see
+ * `probeImage`) and the size and modification time of its file, so that
+ * a batch can be scheduled (e.g. largest first), packed in a memory
+ * budget or given its 8-/16-bit kernels before any image is loaded.
+ *
+ * The index is saved in the directory (file IMAGE_INDEX_NAME). When it is
+ * refreshed, the entries whose file has the same size and modification
+ * time are kept, and only the new or modified files are probed.
+ *
+ * Index file format (text, one image per line):
+ *   "PGMINDEX 1\n"
+ *   then "<type> <width> <height> <maxValue> <rasterOffset> <mtime>
+ *   <size> <name>\n", where type is the digit of the magic number, the
+ *   raster offset is -1 for ASCII images, mtime is in seconds since the
+ *   Epoch, and the name runs to the end of the line.
+ ***********************************************************************/
+
+#ifndef _IMAGE_INDEX_H_
+#define _IMAGE_INDEX_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "PGM.h"
+
+// Name of the index file of a directory
+#define IMAGE_INDEX_NAME ".pgmindex"
+
+typedef struct
+{
+    char *name;                 // File name, in the directory
+    PGMHeader header;           // Header of the image
+    long long mtime;            // Last modification of the file (seconds
+                                // since the Epoch)
+    long long size;             // Size of the file, in bytes
+
+} IndexEntry;
+
+typedef struct
+{
+    IndexEntry *entries;
+    size_t count;
+    bool modified;              // Differs from the saved index (or none
+                                // was saved)
+
+} ImageIndex;
+
+
+/***********************************************************************
+ * Index the images of a directory, reusing its saved index if any. The
+ * files that are not images are left out. The index is not saved (see
+ * `saveImageIndex`).
+ *
+ * PARAMETERS
+ * directory    A directory
+ *
+ * RETURN
+ * index        The index of the images, sorted by name. It must be
+ *              deleted by calling `freeImageIndex`
+ * NULL         In case of error
+ ***********************************************************************/
+ImageIndex* indexDirectory(const char *directory);
+
+
+/***********************************************************************
+ * Save an index in its directory. The index file is replaced at once, so
+ * that a concurrent reader never sees a partial index.
+ *
+ * PARAMETERS
+ * index        A valid pointer to an ImageIndex (of `directory`)
+ * directory    The directory
+ *
+ * RETURN
+ * 0            If no error
+ * non-0        Otherwise (e.g. read-only directory)
+ ***********************************************************************/
+int saveImageIndex(ImageIndex *index, const char *directory);
+
+
+/***********************************************************************
+ * Sort an index by decreasing raster size (see `rasterBytes`), the
+ * largest images first; ties are sorted by name.
+ *
+ * PARAMETERS
+ * index        A valid pointer to an ImageIndex
+ ***********************************************************************/
+void sortIndexLargestFirst(ImageIndex *index);
+
+
+/***********************************************************************
+ * Free an index.
+ *
+ * PAREMETERS
+ * index        A pointer to an ImageIndex (or NULL)
+ ***********************************************************************/
+void freeImageIndex(ImageIndex *index);
+
+#endif // !_IMAGE_INDEX_H_
@@ -0,0 +1,272 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#include "loader.h"
+#include "quantizer.h"
+
+// Bytes read (then decoded and counted) at once by a thread
+#define CHUNK_BYTES (256 * 1024)
+// Maximum number of samples per pixel (RGB)
+#define MAX_CHANNELS 3
+
+typedef struct
+{
+    int fd;
+    off_t rasterOffset;             // Offset of the raster in the file
+    PGM *image;
+    size_t firstRow;                // This job loads [firstRow, endRow)
+    size_t endRow;
+    size_t chunkRows;               // Rows read at once
+    unsigned long long *counts;     // Private histograms (channels x
+                                    // range), NULL if not requested
+    int status;
+
+} LoadJob;
+
+/* Read `size` bytes at `offset`, whatever the number of `pread` needed */
+static int readAt(int fd, unsigned char *buffer, size_t size, off_t offset)
+{
+    while(size > 0)
+    {
+        ssize_t done = pread(fd, buffer, size, offset);
+        if(done < 0 && errno == EINTR)
+            continue;
+        if(done <= 0)
+            return -1; // Error or truncated file
+        buffer += done;
+        size -= (size_t)done;
+        offset += done;
+    }
+    return 0;
+}
+
+/* 16-bit samples are stored most significant byte first */
+static inline void swapChunk8(uint8_t *samples, size_t length)
+{
+    (void)samples;
+    (void)length;
+}
+
+static inline void swapChunk16(uint16_t *samples, size_t length)
+{
+    unsigned char *bytes = (unsigned char*)samples;
+    for(size_t j=0; j<length; j++)
+        samples[j] = (uint16_t)((bytes[2*j] << 8) | bytes[2*j+1]);
+}
+
+/*
+ * Decode `length` samples read from the file (in place) then, while they
+ * are in cache, count them: channel c of the interleaved samples in
+ * counts[c * range ...] (not counted if `counts` is NULL), where `range`
+ * is the number of values of a sample, so that no bound check is needed;
+ * generated for both sample sizes.
+ */
+#define DEFINE_DECODE_CHUNK(NAME, TYPE, SWAP)                                \
+static void NAME(TYPE *samples, size_t length, size_t channels,              \
+                 unsigned long long *counts)                                 \
+{                                                                            \
+    const size_t range = (size_t)1 << (8 * sizeof(TYPE));                    \
+    SWAP(samples, length);                                                   \
+    if(!counts)                                                              \
+        return;                                                              \
+                                                                             \
+    if(channels == 1)                                                        \
+    {                                                                        \
+        for(size_t j=0; j<length; j++)                                       \
+            counts[samples[j]]++;                                            \
+        return;                                                              \
+    }                                                                        \
+    for(size_t j=0, c=0; j<length; j++)                                      \
+    {                                                                        \
+        counts[c * range + samples[j]]++;                                    \
+        if(++c == channels)                                                  \
+            c = 0;                                                           \
+    }                                                                        \
+}
+
+DEFINE_DECODE_CHUNK(decodeChunk8, uint8_t, swapChunk8)
+DEFINE_DECODE_CHUNK(decodeChunk16, uint16_t, swapChunk16)
+
+static void* loadWorker(void *arg)
+{
+    LoadJob *job = arg;
+    PGM *image = job->image;
+    size_t rowLength = image->width * image->channels;
+    size_t rowBytes = rowLength * image->bytesPerSample;
+
+    job->status = 0;
+    for(size_t i=job->firstRow; i<job->endRow && job->status == 0;
+        i+=job->chunkRows)
+    {
+        size_t rows = job->endRow - i < job->chunkRows ? job->endRow - i
+                                                       : job->chunkRows;
+        unsigned char *chunk = (unsigned char*)image->raster + i * rowBytes;
+        if(readAt(job->fd, chunk, rows * rowBytes,
+                  job->rasterOffset + (off_t)(i * rowBytes)) != 0)
+            job->status = -1;
+        else if(image->bytesPerSample == 1)
+            decodeChunk8((uint8_t*)chunk, rows * rowLength, image->channels,
+                         job->counts);
+        else
+            decodeChunk16((uint16_t*)chunk, rows * rowLength,
+                          image->channels, job->counts);
+    }
+    return NULL;
+}
+
+/***********************************************************************
+ * Load the binary raster of `image` (allocated from `header`) on up to
+ * `maxThreads` threads and, if `hists` is not NULL, sum the private
+ * histograms of the threads into them.
+ *
+ * RETURN
+ * 0            If no error
+ * non-0        Otherwise
+ ***********************************************************************/
+static int loadRaster(int fd, const PGMHeader *header, PGM *image,
+                      size_t maxThreads, Histogram *const *hists)
+{
+    size_t rowBytes = image->width * image->channels * image->bytesPerSample;
+    size_t chunkRows = rowBytes > 0 && rowBytes < CHUNK_BYTES
+                     ? CHUNK_BYTES / rowBytes : 1;
+
+    // At least one chunk per thread
+    size_t chunks = (image->height + chunkRows - 1) / chunkRows;
+    size_t numThreads = maxThreads < chunks ? maxThreads : chunks;
+    if(numThreads == 0)
+        numThreads = 1;
+
+    // Private histograms over every value of a sample
+    size_t bins = (size_t)image->maxValue + 1;
+    size_t range = (size_t)1 << (8 * image->bytesPerSample);
+    LoadJob *jobs = calloc(numThreads, sizeof(LoadJob));
+    pthread_t *threads = malloc(numThreads * sizeof(pthread_t));
+    int *started = calloc(numThreads, sizeof(int));
+    int status = jobs && threads && started ? 0 : -1;
+
+    // Contiguous ranges of whole chunks
+    for(size_t t=0; t<numThreads && status == 0; t++)
+    {
+        size_t first = chunks * t / numThreads * chunkRows;
+        size_t end = chunks * (t+1) / numThreads * chunkRows;
+        jobs[t] = (LoadJob){fd, (off_t)header->rasterOffset, image, first,
+                            end < image->height ? end : image->height,
+                            chunkRows, NULL, -1};
+        if(hists)
+        {
+            jobs[t].counts = calloc(image->channels * range,
+                                    sizeof(unsigned long long));
+            status = jobs[t].counts ? 0 : -1;
+        }
+    }
+
+    // Spawn the extra threads, the first job runs here
+    int ready = status == 0;
+    for(size_t t=1; t<numThreads && ready; t++)
+        started[t] = pthread_create(&threads[t], NULL, loadWorker,
+                                    &jobs[t]) == 0;
+
+    for(size_t t=0; t<numThreads && ready; t++)
+    {
+        if(started[t])
+            pthread_join(threads[t], NULL);
+        else
+            loadWorker(&jobs[t]); // Inline fallback
+        if(jobs[t].status != 0)
+            status = jobs[t].status;
+    }
+
+    // Values above maxValue are invalid
+    for(size_t c=0; c<image->channels && hists && status == 0; c++)
+        for(size_t t=0; t<numThreads; t++)
+            for(size_t v=0; v<range; v++)
+            {
+                unsigned long long count = jobs[t].counts[c * range + v];
+                if(v < bins)
+                    hists[c]->count[v] += count;
+                else if(count > 0)
+                    status = -1;
+            }
+
+    for(size_t t=0; jobs && t<numThreads; t++)
+        free(jobs[t].counts);
+    free(jobs);
+    free(threads);
+    free(started);
+    return status;
+}
+
+PGM* loadImage(const char* filename, size_t maxThreads, Histogram** hists)
+{
+    for(size_t c=0; hists && c<MAX_CHANNELS; c++)
+        hists[c] = NULL;
+
+    FILE *file = filename ? fopen(filename, "rb") : NULL;
+    if(!file)
+        return NULL;
+
+    PGMHeader header;
+    if(readImageHeader(file, &header) != 0)
+    {
+        fclose(file);
+        return NULL;
+    }
+
+    if(maxThreads == 0)
+    {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        maxThreads = cores > 0 ? (size_t)cores : 1;
+    }
+
+    PGM *image = NULL;
+    int status = 0;
+    for(size_t c=0; hists && c<header.channels && status == 0; c++)
+    {
+        hists[c] = createEmptyHistogram((size_t)header.maxValue + 1);
+        status = hists[c] ? 0 : -1;
+    }
+
+    if(status == 0 && header.rasterOffset < 0)
+    {
+        // ASCII: serial parsing, then the histograms of the image
+        rewind(file);
+        image = readImage(file);
+        PixelBuffer src = {image ? image->raster : NULL, header.width,
+                           header.channels, header.height,
+                           header.width * header.channels
+                           * header.bytesPerSample,
+                           header.bytesPerSample == 1 ? 8 : 16};
+        status = !image || (hists && quantizerHistogram(&src, hists) != 0);
+    }
+    else if(status == 0)
+    {
+        image = createEmptyMultiChannelImage(header.width, header.height,
+                                             header.channels,
+                                             header.maxValue);
+        if(image)
+            image->type = header.type;
+        status = !image || loadRaster(fileno(file), &header, image,
+                                      maxThreads, hists) != 0;
+    }
+
+    fclose(file);
+    if(status != 0)
+    {
+        freeImage(image);
+        for(size_t c=0; hists && c<MAX_CHANNELS; c++)
+        {
+            freeHistogram(hists[c]);
+            hists[c] = NULL;
+        }
+        return NULL;
+    }
+    return image;
+}
@@ -0,0 +1,44 @@
+/***********************************************************************
+ * Parallel loading of binary (P5/P6) images.
+ *
+ * Once the header is parsed, row i of a binary raster starts at a fixed
+ * byte offset, so the rows are split in contiguous ranges, one per
+ * thread. Each thread reads its range with `pread` (no shared file
+ * position) in chunks of a few hundred KiB, straight into the raster of
+ * the image, then decodes the chunk (16-bit samples are stored most
+ * significant byte first) and counts it in private histograms while it
+ * is still in cache. The private histograms are summed at the end: the
+ * decoding and `image2histogram` are a single parallel pass.
+ *
+ * ASCII images (P2/P3) are read serially, as by `createImageFromFile`.
+ ***********************************************************************/
+
+#ifndef _LOADER_H_
+#define _LOADER_H_
+
+#include <stddef.h>
+
+#include "PGM.h"
+#include "Mapping.h"
+
+
+/***********************************************************************
+ * Load an image and, optionally, the histogram of each of its channels.
+ * The image must later be deleted by calling freeImage().
+ *
+ * PARAMETERS
+ * filename     File name of a pgm (P2/P5) or ppm (P3/P6) image
+ * maxThreads   Maximum number of threads (including the calling one),
+ *              0 for the number of online processors
+ * hists        NULL, or an array of 3 pointers receiving the Histograms
+ *              (of length maxValue+1) of the `channels` channels, the
+ *              others being set to NULL. They must be deleted by calling
+ *              `freeHistogram`
+ *
+ * RETURN
+ * NULL         if any error (no histogram is then returned)
+ * image        The read image
+ ***********************************************************************/
+PGM* loadImage(const char* filename, size_t maxThreads, Histogram** hists);
+
+#endif // !_LOADER_H_
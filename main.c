@@ -1,259 +1,1375 @@
-/* ========================================================================= *
- * File parsing and Main Function
-
- * ------------------------------------------------------------------------- *
- * NOM
- *      quantizer
- * SYNOPSIS
- *      quantizer inputImg k outputName
- * DESCIRPTION
- *      Quantizes the input image on k levels and save it.
- * USAGE
- *      ./quantizer lena.pgm 4 lena_4.pgm
- *          Will compress the image lena.pgm on 4 levels and save it under
- *          the name "lena_4.pgm".
- * ------------------------------------------------------------------------- *
- * ========================================================================= */
-
-#include <stdio.h>
-#include <stddef.h>
-#include <stdlib.h>
-#include <float.h>
-
-#include "PGM.h"
-#include "Mapping.h"
-#include "compression.h"
-
-
-
-/*-----------------------------------------------------------------------------+
-|                              COMPRESSION                                     |
-+-----------------------------------------------------------------------------*/
-typedef struct
-{
-    PGM *compressed;
-    double error;
-
-} Compression;
-
-
-
-/*************************************************************************
- * Apply the mapping to the images to create a compressed images.
- * The compressed images must be free with `freeImage`.
- *
- * PARAMETERS
- * mapping      A valid pointer to a Mapping
- * image        A valid pointer to a PGM image
- *
- * RETURN
- * comp         A Compression structure. In case of error, the `compressed`
- *              field will be set to NULL. Otherwise, contains the
- *              compressed image and the associated compression error
- *************************************************************************/
-static Compression applyMapping(const Mapping *mapping, const PGM *image)
-{
-    PGM* compressedImg = createEmptyImage(image->width,
-                                                      image->height,
-                                                      image->maxValue);
-
-    uint16_t *lookUpTable = mapping2Lookup(mapping, image->maxValue);
-
-    if(!compressedImg || !lookUpTable)
-    {
-        freeImage(compressedImg);
-        free(lookUpTable);
-        return (Compression){NULL, DBL_MAX};
-    }
-
-    double err = 0, delta;
-    uint16_t old, new;
-
-    // Apply compression to image
-    for(size_t i=0; i<image->height; i++)
-    {
-        for(size_t j=0; j<image->width; j++)
-        {
-            // Compute error
-            old = image->array[i][j];
-            new = lookUpTable[old];
-            delta = (double)old - (double)new;
-            err += (delta*delta);
-
-            // Actually apply compression
-            compressedImg->array[i][j] = new;
-        }
-    }
-
-
-    free(lookUpTable);
-
-    return (Compression){compressedImg, err};
-}
-
-
-
-/***********************************************************************
- * Compute the histogram of the given image
- *
- * PARAMETERS
- * img          A valid pointer to a PGM structure
- *
- * RETURN
- * histo       A pointer to a Histogram. It must be deleted by calling
- *             `freeHistogram`
- * NULL        In case of error
- ***********************************************************************/
-static Histogram* image2histogram(const PGM* img)
-{
-    if(!img)
-        return NULL;
-
-    Histogram *hist = createEmptyHistogram(img->maxValue+1);
-    if(!hist)
-        return NULL;
-
-    for(size_t i=0; i<img->height; i++)
-        for(size_t j=0; j<img->width; j++)
-            hist->count[img->array[i][j]]++;
-
-    return hist;
-}
-
-
-
-/***********************************************************************
- * Free the memory allocated by the given inputs
- *
- * PAREMETERS
- * h      A pointer to a Histogram
- * m      A pointer to a Mapping
- * pgm    A pointer to a PGM
- ***********************************************************************/
-static inline void freeAll(Histogram *h, Mapping *m, PGM* pgm)
-{
-    freeHistogram(h);
-    freeMapping(m);
-    freeImage(pgm);
-
-}
-
-/***********************************************************************
- * Compress the given image on `nLevels` levels.
- *
- * PAREMETERS
- * image      A valid pointer to a Histogram
- * nLevels    The number of levels
- *
- * RETURN
- * comp         A Compression structure. In case of error, the `compressed`
- *              field will be set to NULL. Otherwise, contains the
- *              compressed image and the associated compression error
- ***********************************************************************/
-static Compression compressImage(const PGM *image, size_t nLevels)
-{
-    if(nLevels == 0 || !image)
-        return (Compression){NULL, DBL_MAX};
-
-    Histogram *hist = NULL;
-    Mapping *mapping = NULL;
-    PGM* compressedImg = NULL;
-
-
-    hist = image2histogram(image);
-    if(!hist)
-    {
-        freeAll(hist, mapping, compressedImg);
-        return (Compression){NULL, DBL_MAX};
-    }
-
-
-    mapping = computeMapping(hist, nLevels);
-    if(!mapping)
-    {
-        freeAll(hist, mapping, compressedImg);
-        return (Compression){NULL, DBL_MAX};
-    }
-
-    Compression compression = applyMapping(mapping, image);
-    compressedImg = compression.compressed;
-    if(!compressedImg)
-    {
-        freeAll(hist, mapping, compressedImg);
-        return (Compression){NULL, DBL_MAX};
-    }
-
-
-    // Free local resources
-
-    freeAll(hist, mapping, NULL);
-
-    return compression;
-}
-
-
-/*-----------------------------------------------------------------------------+
-|                                  MAIN                                        |
-+-----------------------------------------------------------------------------*/
-int main(int argc, char** argv)
-{
-    // Checking arguments
-    if (argc != 4)
-    {
-        /*
-         * argv[0]: name of the executable
-         * argv[1]: name of the input file
-         * argv[2]: number of levels
-         * argv[3]: name of the output file
-         */
-        fprintf(stderr, "Usage: %s <PGM input image> <unsgined int> "
-                        "<PGM output name>\n", argv[0]);
-        return EXIT_FAILURE;
-    }
-
-    // Parse arguments
-    size_t nbLevels = 0;
-    if(sscanf(argv[2], "%zu", &nbLevels) != 1)
-    {
-        fprintf(stderr, "Aborting; number of levels should be unsigned int. "
-                        "Got '%s'.\n", argv[2]);
-        return EXIT_FAILURE;
-    }
-
-    // Load input Image
-    PGM* inputImg = createImageFromFile(argv[1]);
-    if(!inputImg)
-    {
-        fprintf(stderr, "Aborting; error while loading input image '%s'\n",
-                argv[1]);
-        return EXIT_FAILURE;
-    }
-
-
-    // Compress
-    Compression compression = compressImage(inputImg, nbLevels);
-    PGM* outputImg = compression.compressed;
-    if(!outputImg)
-    {
-        fprintf(stderr, "Aborting; error while computing the reduction\n");
-        freeImage(inputImg);
-        return EXIT_FAILURE;
-    }
-
-    fprintf(stdout, "Compression error: %lf\n", compression.error);
-
-
-    // Save output image
-    if(saveImageToFile(outputImg, argv[3]) != 0)
-    {
-        fprintf(stderr, "Aborting; error while saving output image in '%s'\n",
-                argv[3]);
-        freeImage(inputImg);
-        freeImage(outputImg);
-        return EXIT_FAILURE;
-    }
-
-    freeImage(inputImg);
-    freeImage(outputImg);
-    return EXIT_SUCCESS;
-}
+/* ========================================================================= *
+ * File parsing and Main Function
+
+ * ------------------------------------------------------------------------- *
+ * NOM
+ *      quantizer
+ * SYNOPSIS
+ *      quantizer [-s sampleRate] [-i] [-q optimality] [-m MiB] [-t cores]
+ *                [-e l2|l1] [-w weights] [-d seconds]
+ *                inputImg k[,k2,...] outputName
+ *      quantizer [options] - k -
+ *      quantizer [-e l2|l1] [-w weights] -p inputImg k outputStream
+ *      quantizer -r inputStream k outputImg
+ * DESCIRPTION
+ *      Quantizes the input image on k levels and save it. Color images
+ *      (PPM) are quantized on k levels per channel.
+ *      With several numbers of levels, the image is loaded and its
+ *      histogram computed once, and all the outputs are written in a
+ *      single pass over the pixels; the output on k levels is saved
+ *      under outputName with "_k" before the extension.
+ *      -s  The mapping is computed from the histogram of a fraction
+ *          sampleRate (in ]0, 1], 1 for all of them) of the pixels only.
+ *      -i  Save the index of the level of each pixel instead of the level
+ *          (k <= 256); the levels (palette) are printed on stdout.
+ *      -q  Optimality required from the mapping: approximate, near
+ *          (default) or exact. The fastest solver meeting it (and the
+ *          memory limit) is chosen, and the plan is logged on stderr.
+ *      -m  Memory limit of the compression, in MiB (default: none).
+ *      -t  Number of cores to use (default: all).
+ *      -e  Error minimized by the mapping: l2 (squared, default) or l1
+ *          (absolute). The error for this metric is printed as well.
+ *      -w  Text file giving the weight (e.g. perceptual importance) of
+ *          each gray level, from 0 to the maximum value: the error of a
+ *          pixel is multiplied by the weight of its value.
+ *      -d  Time budget of each mapping, in seconds: the anytime solver
+ *          returns the best mapping found in time (and tells on stderr
+ *          whether it is proven optimal) instead of the planned solver.
+ *      -p  Progressive output (k = 2^depth, up to 256): the mappings on
+ *          2, 4, ..., k levels are nested (each one splits every interval
+ *          of the previous one in two, the sum of their errors being
+ *          minimal; beyond 512 distinct values, each interval is split
+ *          level by level instead, which stderr reports as approximate)
+ *          and the output is a stream of `depth` bit planes
+ *          (see "progressive.h"): each one refines the image received so
+ *          far by one bit per sample.
+ *      -r  Decode the first planes of a progressive stream: the image on
+ *          k (a power of two) levels, or on all of them if the stream
+ *          holds less planes.
+ *      With "-" as input and output, any number of images concatenated
+ *      on stdin (e.g. frames sent through a pipe) are quantized one after
+ *      the other and written to stdout in the same order; the errors are
+ *      printed on stderr. The next image is decoded while the current
+ *      one is quantized, and at most STREAM_DEPTH decoded images wait.
+ * USAGE
+ *      ./quantizer lena.pgm 4 lena_4.pgm
+ *          Will compress the image lena.pgm on 4 levels and save it under
+ *          the name "lena_4.pgm".
+ *      ./quantizer -s 0.01 scan.pgm 4 scan_4.pgm
+ *          Same, computing the mapping from 1% of the pixels.
+ *      ./quantizer lena.pgm 2,4,8,16 lena.pgm
+ *          Will save lena_2.pgm, lena_4.pgm, lena_8.pgm and lena_16.pgm.
+ *      ./quantizer -p lena.pgm 16 lena.pq && ./quantizer -r lena.pq 4 x.pgm
+ *          Will save the progressive stream of lena.pgm on 2 to 16 levels,
+ *          then decode its preview on 4 levels from the first 2 planes.
+ *      cat a.pgm b.pgm | ./quantizer - 4 - > ab_4.pgm
+ *          Will quantize every frame on 4 levels.
+ * ------------------------------------------------------------------------- *
+ * ========================================================================= */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <float.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "PGM.h"
+#include "Mapping.h"
+#include "compression.h"
+#include "quantizer.h"
+#include "sampling.h"
+#include "planner.h"
+#include "progressive.h"
+#include "loader.h"
+
+
+
+/*-----------------------------------------------------------------------------+
+|                              COMPRESSION                                     |
++-----------------------------------------------------------------------------*/
+// Maximum number of samples per pixel (RGB)
+#define MAX_CHANNELS 3
+// Maximum number of outputs of a fan-out compression
+#define MAX_OUTPUTS 16
+
+typedef struct
+{
+    PGM *compressed;
+    double error;
+    Mapping *palettes[MAX_CHANNELS];    // OUTPUT_INDEX only: the levels
+                                        // of each channel (NULL otherwise)
+    double metricError;                 // Error of the mappings for the
+                                        // metric of the options, on the
+                                        // histograms they were computed
+                                        // from
+} Compression;
+
+/* What `compressImage` produces */
+typedef enum
+{
+    OUTPUT_COPY,        // A new quantized image
+    OUTPUT_IN_PLACE,    // The input image, overwritten with quantized values
+    OUTPUT_INDEX        // A new image of level indices (one byte per sample)
+
+} OutputMode;
+
+/* How `compressImage` works */
+typedef struct
+{
+    size_t nLevels;                 // Number of levels
+    double sampleRate;              // Fraction of the pixels used to compute
+                                    // the mappings (exact if >= 1)
+    OutputMode mode;                // The kind of output
+    PlannerConstraints constraints; // Constraints of the planner (which
+                                    // chooses the solver and the threads)
+    double budget;                  // If > 0, the mappings are computed by
+                                    // the anytime solver within this time
+                                    // (seconds) instead of the planned one
+} CompressionOptions;
+
+
+
+/*************************************************************************
+ * View the raster of an image as a PixelBuffer (no copy).
+ *
+ * PARAMETERS
+ * image        A valid pointer to a PGM image
+ *
+ * RETURN
+ * buffer       A PixelBuffer sharing the memory of `image`
+ *************************************************************************/
+static PixelBuffer image2buffer(const PGM *image)
+{
+    return (PixelBuffer){image->raster, image->width, image->channels,
+                         image->height,
+                         image->width * image->channels
+                                      * image->bytesPerSample,
+                         image->bytesPerSample == 1 ? 8 : 16};
+}
+
+
+
+/*************************************************************************
+ * Apply the mappings (one per channel) to the images to create a
+ * compressed images. All channels are remapped in a single pass.
+ * The compressed images must be free with `freeImage`.
+ *
+ * PARAMETERS
+ * mappings     An array of `image->channels` valid pointers to Mapping
+ * image        A valid pointer to a PGM image
+ * inPlace      If true, `image` itself is overwritten and returned as the
+ *              compressed image (no second raster is allocated). Either
+ *              way, the compressed image has the file format of `image`
+ *
+ * RETURN
+ * comp         A Compression structure. In case of error, the `compressed`
+ *              field will be set to NULL. Otherwise, contains the
+ *              compressed image and the associated compression error
+ *************************************************************************/
+static Compression applyMapping(Mapping *const *mappings, PGM *image,
+                                bool inPlace)
+{
+    PGM* compressedImg = inPlace ? image
+                                 : createEmptyMultiChannelImage(image->width,
+                                                                image->height,
+                                                                image->channels,
+                                                                image->maxValue);
+    // Same file format as the input, whether remapped in place or not
+    if(compressedImg && !inPlace)
+        compressedImg->type = image->type;
+
+    uint16_t *lookUpTables[MAX_CHANNELS] = {NULL};
+    int valid = compressedImg != NULL;
+    for(size_t c=0; c<image->channels; c++)
+    {
+        lookUpTables[c] = mapping2Lookup(mappings[c], image->maxValue);
+        valid = valid && lookUpTables[c];
+    }
+
+    // Apply compression to image and compute error
+    double err = 0;
+    if(valid)
+    {
+        PixelBuffer src = image2buffer(image);
+        PixelBuffer dst = image2buffer(compressedImg);
+        valid = quantizerRemap(&src, &dst,
+                               (const uint16_t *const *)lookUpTables,
+                               image->maxValue+1, &err) == 0;
+    }
+
+    for(size_t c=0; c<image->channels; c++)
+        free(lookUpTables[c]);
+
+    if(!valid)
+    {
+        if(!inPlace)
+            freeImage(compressedImg);
+        return (Compression){NULL, DBL_MAX, {NULL}, DBL_MAX};
+    }
+
+    return (Compression){compressedImg, err, {NULL}, DBL_MAX};
+}
+
+
+
+/*************************************************************************
+ * Create the index image of the given image: each sample is replaced by
+ * the index of its level in the mapping of its channel, on one byte.
+ * The index image must be free with `freeImage`.
+ *
+ * PARAMETERS
+ * mappings     An array of `image->channels` valid pointers to Mapping,
+ *              with at most 256 levels
+ * image        A valid pointer to a PGM image
+ *
+ * RETURN
+ * comp         A Compression structure whose `compressed` field is the
+ *              index image, in the file format of `image` (NULL in case of
+ *              error). The palettes are NOT set.
+ *************************************************************************/
+static Compression indexMapping(Mapping *const *mappings, const PGM *image)
+{
+    size_t nLevels = mappings[0]->nLevels;
+    if(nLevels == 0 || nLevels > UINT8_MAX+1)
+        return (Compression){NULL, DBL_MAX, {NULL}, DBL_MAX};
+
+    // A valid file needs a maximum value of at least 1 (a single level
+    // still has index 0 only)
+    PGM* indexImg = createEmptyMultiChannelImage(image->width, image->height,
+                                                 image->channels,
+                                                 nLevels > 1 ? nLevels-1 : 1);
+    if(indexImg)
+        indexImg->type = image->type; // Same file format as the input
+
+    uint8_t *indexTables[MAX_CHANNELS] = {NULL};
+    int valid = indexImg != NULL;
+    for(size_t c=0; c<image->channels && valid; c++)
+    {
+        indexTables[c] = malloc((size_t)image->maxValue+1);
+        valid = indexTables[c]
+                && mapping2IndexBuffer(mappings[c], image->maxValue,
+                                       indexTables[c]) == 0;
+    }
+
+    double err = 0;
+    if(valid)
+    {
+        PixelBuffer src = image2buffer(image);
+        PixelBuffer dst = image2buffer(indexImg);
+        valid = quantizerIndex(&src, &dst, (const uint8_t *const *)indexTables,
+                               mappings, image->maxValue+1, &err) == 0;
+    }
+
+    for(size_t c=0; c<image->channels; c++)
+        free(indexTables[c]);
+
+    if(!valid)
+    {
+        freeImage(indexImg);
+        return (Compression){NULL, DBL_MAX, {NULL}, DBL_MAX};
+    }
+
+    return (Compression){indexImg, err, {NULL}, DBL_MAX};
+}
+
+
+
+/***********************************************************************
+ * Compute the histogram of each channel of the given image, in a single
+ * pass over the pixels.
+ *
+ * PARAMETERS
+ * img          A valid pointer to a PGM structure
+ * sampling     If not NULL, only the sampled pixels are counted
+ * hists        An array of `img->channels` pointers, each receiving a
+ *              Histogram. They must be deleted by calling `freeHistogram`
+ *              (even in case of error)
+ *
+ * RETURN
+ * 0            If no error
+ * non-0        Otherwise
+ ***********************************************************************/
+static int image2histograms(const PGM* img, const Sampling *sampling,
+                            Histogram **hists)
+{
+    if(!img)
+        return -1;
+
+    for(size_t c=0; c<img->channels; c++)
+    {
+        hists[c] = createEmptyHistogram(img->maxValue+1);
+        if(!hists[c])
+            return -1;
+    }
+
+    PixelBuffer src = image2buffer(img);
+    if(sampling)
+        return sampledHistogram(&src, hists, *sampling);
+    return quantizerHistogram(&src, hists);
+}
+
+
+
+/***********************************************************************
+ * Free the memory allocated by the given inputs
+ *
+ * PAREMETERS
+ * h         An array of pointers to Histogram
+ * m         An array of pointers to Mapping
+ * channels  The number of entries of `h` and `m`
+ * pgm       A pointer to a PGM
+ ***********************************************************************/
+static inline void freeAll(Histogram **h, Mapping **m, size_t channels,
+                           PGM* pgm)
+{
+    for(size_t c=0; c<channels; c++)
+    {
+        freeHistogram(h[c]);
+        freeMapping(m[c]);
+    }
+    freeImage(pgm);
+
+}
+
+/***********************************************************************
+ * `anytimeMapping` as a MappingSolver: the context is the
+ * CompressionOptions (budget and metric). The error of the mapping and
+ * whether it is optimal are logged on stderr.
+ ***********************************************************************/
+static Mapping* anytimeSolver(const Histogram *histogram, size_t nLevels,
+                              const void *context)
+{
+    const CompressionOptions *options = context;
+    CumulativeHistogram *cumulative =
+        createMetricCumulativeHistogram(histogram,
+                                        &options->constraints.metric);
+    if(!cumulative)
+        return NULL;
+
+    double error = 0;
+    bool optimal = false;
+    Mapping *mapping = anytimeMapping(cumulative, nLevels, options->budget,
+                                      &error, &optimal);
+    freeCumulativeHistogram(cumulative);
+
+    if(mapping)
+        fprintf(stderr, "Anytime: error=%.0f (%s) within %gs\n", error,
+                optimal ? "optimal" : "best found", options->budget);
+    return mapping;
+}
+
+/***********************************************************************
+ * Plan the solve of the given histograms on `nLevels` levels, log the
+ * plan on stderr and compute the mappings.
+ *
+ * PAREMETERS
+ * hists        An array of `image->channels` valid pointers to Histogram
+ * image        A valid pointer to the image of the histograms
+ * nLevels      The number of levels
+ * options      A valid pointer to the options (their `nLevels` is ignored)
+ * mappings     An array of `image->channels` pointers, each receiving a
+ *              Mapping. They must be deleted by calling `freeMapping`
+ *              (even in case of error)
+ * plan         Receives the plan
+ *
+ * RETURN
+ * 0            If no error
+ * non-0        Otherwise
+ ***********************************************************************/
+static int solveMappings(Histogram *const *hists, const PGM *image,
+                         size_t nLevels, const CompressionOptions *options,
+                         Mapping **mappings, Plan *plan)
+{
+    size_t channels = image->channels;
+    for(size_t c=0; c<channels; c++)
+    {
+        mappings[c] = createUninitializedMapping(nLevels);
+        if(!mappings[c])
+            return -1;
+    }
+
+    PlannerConstraints constraints = options->constraints;
+    constraints.allowInPlace = options->mode == OUTPUT_IN_PLACE;
+    PlanInput input = planInput(hists, channels, nLevels,
+                                image->width * image->height,
+                                image->bytesPerSample,
+                                options->mode == OUTPUT_INDEX);
+    if(planCompression(&input, &constraints, plan) != 0)
+        fprintf(stderr, "Warning; no plan fits in the memory limit, "
+                        "using the leanest one\n");
+
+    // The anytime solver replaces the planned one (and logs itself)
+    if(options->budget > 0)
+        return quantizerSolveMappings(hists, mappings, channels,
+                                      anytimeSolver, options, plan->threads);
+    logPlan(stderr, &input, plan);
+    return quantizerSolveMappings(hists, mappings, channels,
+                                  computeMappingWithPlan, plan,
+                                  plan->threads);
+}
+
+/***********************************************************************
+ * Error of the mappings of all channels for the given metric, computed
+ * from their histograms (see `computeMetricError`).
+ ***********************************************************************/
+static double metricError(Mapping *const *mappings, Histogram *const *hists,
+                          size_t channels, const ErrorMetric *metric)
+{
+    double error = 0;
+    for(size_t c=0; c<channels; c++)
+    {
+        double e = computeMetricError(mappings[c], hists[c], metric);
+        if(e == DBL_MAX)
+            return DBL_MAX;
+        error += e;
+    }
+    return error;
+}
+
+/***********************************************************************
+ * Compress the given image. Each channel of a color image gets its own
+ * mapping; the mappings are solved concurrently. The solver is chosen by
+ * the planner, and the plan is logged on stderr.
+ *
+ * PAREMETERS
+ * image      A valid pointer to a Histogram
+ * histograms NULL, or the `image->channels` histograms of the image,
+ *            e.g. from `loadImage`: they are then used instead of
+ *            computing (or sampling) them, and freed
+ * options    A valid pointer to the options. With OUTPUT_IN_PLACE,
+ *            `image` may be modified and returned as the compressed image
+ *
+ * RETURN
+ * comp         A Compression structure. In case of error, the `compressed`
+ *              field will be set to NULL. Otherwise, contains the
+ *              compressed image and the associated compression error
+ ***********************************************************************/
+static Compression compressImage(PGM *image, Histogram **histograms,
+                                 const CompressionOptions *options)
+{
+    const Compression failure = {NULL, DBL_MAX, {NULL}, DBL_MAX};
+    size_t nLevels = options->nLevels;
+    double sampleRate = options->sampleRate;
+    OutputMode mode = options->mode;
+    Histogram *hists[MAX_CHANNELS] = {NULL};
+    Mapping *mappings[MAX_CHANNELS] = {NULL};
+    size_t channels = image ? image->channels : 0;
+
+    if(nLevels == 0 || !image || channels > MAX_CHANNELS)
+    {
+        for(size_t c=0; histograms && c<channels; c++)
+            freeHistogram(histograms[c]);
+        return failure;
+    }
+    for(size_t c=0; histograms && c<channels; c++)
+        hists[c] = histograms[c];
+
+
+    Sampling sampling = samplingFromRate(sampleRate, SAMPLING_RANDOM);
+    Plan plan;
+    if((!histograms
+        && image2histograms(image, sampleRate < 1 ? &sampling : NULL,
+                            hists) != 0)
+       || solveMappings(hists, image, nLevels, options, mappings, &plan) != 0)
+    {
+        freeAll(hists, mappings, channels, NULL);
+        return failure;
+    }
+
+    Compression compression = mode == OUTPUT_INDEX
+        ? indexMapping(mappings, image)
+        : applyMapping(mappings, image, plan.inPlace);
+    if(!compression.compressed)
+    {
+        freeAll(hists, mappings, channels, NULL);
+        return failure;
+    }
+    compression.metricError = metricError(mappings, hists, channels,
+                                          &options->constraints.metric);
+
+    // The mappings become the palettes of the index image
+    if(mode == OUTPUT_INDEX)
+        for(size_t c=0; c<channels; c++)
+        {
+            compression.palettes[c] = mappings[c];
+            mappings[c] = NULL;
+        }
+
+
+    // Free local resources
+
+    freeAll(hists, mappings, channels, NULL);
+
+    return compression;
+}
+
+/***********************************************************************
+ * Compress the given image on several numbers of levels at once. The
+ * histograms are computed once, then one set of mappings is solved per
+ * number of levels, and all of them are applied in a single pass over
+ * the pixels (see `quantizerRemapMany`).
+ *
+ * PAREMETERS
+ * image        A valid pointer to a PGM image (not modified)
+ * options      A valid pointer to the options (their `nLevels` is
+ *              ignored, their mode must be OUTPUT_COPY)
+ * levels       The `count` numbers of levels
+ * count        The number of outputs, at most MAX_OUTPUTS
+ * compressions Receives the `count` compressions. The compressed images
+ *              must be free with `freeImage`
+ *
+ * RETURN
+ * 0            If no error
+ * non-0        Otherwise (no compressed image is then returned)
+ ***********************************************************************/
+static int compressImageFanOut(const PGM *image,
+                               const CompressionOptions *options,
+                               const size_t *levels, size_t count,
+                               Compression *compressions)
+{
+    if(!image || image->channels > MAX_CHANNELS || count == 0
+       || count > MAX_OUTPUTS || options->mode != OUTPUT_COPY)
+        return -1;
+
+    Histogram *hists[MAX_CHANNELS] = {NULL};
+    Mapping *mappings[MAX_OUTPUTS][MAX_CHANNELS] = {{NULL}};
+    uint16_t *lookUpTables[MAX_OUTPUTS][MAX_CHANNELS] = {{NULL}};
+    const uint16_t *const *tables[MAX_OUTPUTS];
+    PixelBuffer buffers[MAX_OUTPUTS];
+    PixelBuffer *dsts[MAX_OUTPUTS];
+    double errors[MAX_OUTPUTS];
+    size_t channels = image->channels;
+    for(size_t o=0; o<count; o++)
+        compressions[o] = (Compression){NULL, DBL_MAX, {NULL}, DBL_MAX};
+
+    // One histogram per channel, whatever the number of outputs
+    Sampling sampling = samplingFromRate(options->sampleRate,
+                                         SAMPLING_RANDOM);
+    int status = image2histograms(image, options->sampleRate < 1
+                                         ? &sampling : NULL, hists);
+
+    for(size_t o=0; o<count && status == 0; o++)
+    {
+        Plan plan;
+        status = levels[o] == 0
+            || solveMappings(hists, image, levels[o], options, mappings[o],
+                             &plan) != 0;
+        for(size_t c=0; c<channels && status == 0; c++)
+        {
+            lookUpTables[o][c] = mapping2Lookup(mappings[o][c],
+                                                image->maxValue);
+            status = !lookUpTables[o][c];
+        }
+        if(status != 0)
+            break;
+
+        compressions[o].metricError =
+            metricError(mappings[o], hists, channels,
+                        &options->constraints.metric);
+        compressions[o].compressed =
+            createEmptyMultiChannelImage(image->width, image->height,
+                                         channels, image->maxValue);
+        status = !compressions[o].compressed;
+        if(status == 0)
+        {
+            compressions[o].compressed->type = image->type;
+            buffers[o] = image2buffer(compressions[o].compressed);
+            dsts[o] = &buffers[o];
+            tables[o] = (const uint16_t *const *)lookUpTables[o];
+        }
+    }
+
+    // All the outputs in a single pass
+    if(status == 0)
+    {
+        PixelBuffer src = image2buffer(image);
+        status = quantizerRemapMany(&src, dsts, tables, count,
+                                    image->maxValue+1, errors);
+    }
+
+    for(size_t o=0; o<count; o++)
+    {
+        if(status == 0)
+            compressions[o].error = errors[o];
+        else
+        {
+            freeImage(compressions[o].compressed);
+            compressions[o].compressed = NULL;
+        }
+        for(size_t c=0; c<channels; c++)
+        {
+            freeMapping(mappings[o][c]);
+            free(lookUpTables[o][c]);
+        }
+    }
+    for(size_t c=0; c<channels; c++)
+        freeHistogram(hists[c]);
+
+    return status;
+}
+
+
+/*-----------------------------------------------------------------------------+
+|                                PROGRESSIVE                                   |
++-----------------------------------------------------------------------------*/
+/***********************************************************************
+ * Depth of a number of levels: d such that nLevels = 2^d, 0 if it is not
+ * a power of two or exceeds 2^MAX_NESTED_DEPTH.
+ ***********************************************************************/
+static size_t levelsDepth(size_t nLevels)
+{
+    for(size_t depth=1; depth<=MAX_NESTED_DEPTH; depth++)
+        if(nLevels == (size_t)1 << depth)
+            return depth;
+    return 0;
+}
+
+/***********************************************************************
+ * Solve the nested mappings of each channel of the image on 2, 4, ...,
+ * 2^depth levels for the metric of the options, print the error of each
+ * level, tell on stderr whether the hierarchy is optimal and write the
+ * progressive stream (see `writeProgressive`).
+ *
+ * PAREMETERS
+ * image        A valid pointer to a PGM image
+ * options      A valid pointer to the options
+ * depth        The depth of the hierarchy
+ * outputName   The name of the stream
+ *
+ * RETURN
+ * EXIT_SUCCESS If no error
+ * EXIT_FAILURE Otherwise
+ ***********************************************************************/
+static int compressProgressive(const PGM *image,
+                               const CompressionOptions *options,
+                               size_t depth, const char *outputName)
+{
+    size_t channels = image->channels;
+    Histogram *hists[MAX_CHANNELS] = {NULL};
+    Mapping *mappings[MAX_NESTED_DEPTH * MAX_CHANNELS] = {NULL};
+    Mapping *nested[MAX_NESTED_DEPTH];
+    const ErrorMetric *metric = &options->constraints.metric;
+
+    // Every channel gets the smallest depth of all of them
+    bool optimal = true;
+    int status = image2histograms(image, NULL, hists);
+    for(size_t c=0; c<channels && status == 0; c++)
+    {
+        CumulativeHistogram *cumulative =
+            createMetricCumulativeHistogram(hists[c], metric);
+        bool channelOptimal = false;
+        size_t solved = cumulative ? nestedMappings(cumulative, depth, nested,
+                                                    &channelOptimal)
+                                   : 0;
+        freeCumulativeHistogram(cumulative);
+        optimal = optimal && channelOptimal;
+        for(size_t j=0; j<solved; j++)
+            mappings[j * channels + c] = nested[j];
+        status = solved == 0;
+        if(solved < depth)
+            depth = solved;
+    }
+
+    if(status == 0)
+        fprintf(stderr, "Nested mappings: %s\n", optimal ? "optimal"
+                : "approximate (too many values: each interval is split in "
+                  "two, level by level)");
+
+    for(size_t j=0; j<depth && status == 0; j++)
+    {
+        double error = 0;
+        for(size_t c=0; c<channels; c++)
+            error += computeError(mappings[j * channels + c], hists[c]);
+        fprintf(stdout, "Compression error (k=%zu): %lf\n",
+                (size_t)2 << j, error);
+        if(metric->weights || metric->norm != NORM_L2)
+            fprintf(stdout, "Metric error (k=%zu): %lf\n", (size_t)2 << j,
+                    metricError(&mappings[j * channels], hists, channels,
+                                metric));
+    }
+
+    if(status == 0)
+    {
+        FILE *file = fopen(outputName, "wb");
+        status = !file || writeProgressive(file, image, mappings, depth) != 0;
+        if(file && fclose(file) != 0)
+            status = -1;
+        if(status != 0)
+            fprintf(stderr, "Aborting; error while saving the stream in "
+                            "'%s'\n", outputName);
+    }
+    else
+        fprintf(stderr, "Aborting; error while computing the nested "
+                        "mappings\n");
+
+    for(size_t i=0; i<MAX_NESTED_DEPTH * MAX_CHANNELS; i++)
+        freeMapping(mappings[i]);
+    for(size_t c=0; c<channels; c++)
+        freeHistogram(hists[c]);
+    return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/***********************************************************************
+ * Decode the preview on `nLevels` levels of a progressive stream and
+ * save it.
+ *
+ * RETURN
+ * EXIT_SUCCESS If no error
+ * EXIT_FAILURE Otherwise
+ ***********************************************************************/
+static int decodeProgressive(const char *inputName, size_t nLevels,
+                             const char *outputName)
+{
+    size_t depth = levelsDepth(nLevels);
+    if(depth == 0)
+    {
+        fprintf(stderr, "Aborting; the number of levels of a progressive "
+                        "stream is a power of two (at most %d). Got %zu.\n",
+                1 << MAX_NESTED_DEPTH, nLevels);
+        return EXIT_FAILURE;
+    }
+
+    FILE *file = fopen(inputName, "rb");
+    size_t decoded = 0;
+    PGM *image = file ? readProgressive(file, depth, &decoded) : NULL;
+    if(file)
+        fclose(file);
+    if(!image)
+    {
+        fprintf(stderr, "Aborting; error while reading the stream '%s'\n",
+                inputName);
+        return EXIT_FAILURE;
+    }
+
+    fprintf(stdout, "Decoded planes: %zu (k=%zu)\n", decoded,
+            (size_t)1 << decoded);
+    int status = saveImageToFile(image, outputName);
+    freeImage(image);
+    if(status != 0)
+    {
+        fprintf(stderr, "Aborting; error while saving output image in "
+                        "'%s'\n", outputName);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+
+
+/*-----------------------------------------------------------------------------+
+|                                  STREAM                                      |
++-----------------------------------------------------------------------------*/
+// Maximum number of decoded images waiting to be quantized
+#define STREAM_DEPTH 2
+
+/* Images decoded by the reader thread, waiting to be quantized */
+typedef struct
+{
+    FILE *input;
+    PGM *images[STREAM_DEPTH];      // Circular buffer
+    size_t first;                   // Index of the oldest image
+    size_t count;                   // Number of waiting images
+    bool ended;                     // No image will be added anymore
+    int status;                     // Non-0 if the input is invalid
+    bool stopped;                   // The consumer gave up
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+
+} ImageQueue;
+
+/***********************************************************************
+ * Reader thread: decode the images of `queue->input` one after the other
+ * and add them to the queue, waiting while it is full.
+ ***********************************************************************/
+static void* streamReader(void *arg)
+{
+    ImageQueue *queue = arg;
+    while(true)
+    {
+        // Decoding happens outside of the lock
+        int status = 0;
+        PGM *image = NULL;
+        bool end = endOfImages(queue->input) != 0;
+        if(!end && !(image = readImage(queue->input)))
+            status = -1;
+
+        pthread_mutex_lock(&queue->lock);
+        while(image && queue->count == STREAM_DEPTH && !queue->stopped)
+            pthread_cond_wait(&queue->changed, &queue->lock);
+        bool stopped = queue->stopped;
+        if(image && !stopped)
+        {
+            queue->images[(queue->first + queue->count) % STREAM_DEPTH] =
+                image;
+            queue->count++;
+        }
+        if(!image)
+        {
+            queue->ended = true;
+            queue->status = status;
+        }
+        pthread_cond_broadcast(&queue->changed);
+        pthread_mutex_unlock(&queue->lock);
+
+        if(stopped)
+            freeImage(image);
+        if(!image || stopped)
+            return NULL;
+    }
+}
+
+/***********************************************************************
+ * Take the oldest image of the queue, waiting for the reader thread.
+ *
+ * RETURN
+ * image        The image (it must be free with `freeImage`)
+ * NULL         At the end of the stream, or if it is invalid (then
+ *              `queue->status` is non-0)
+ ***********************************************************************/
+static PGM* nextImage(ImageQueue *queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    while(queue->count == 0 && !queue->ended)
+        pthread_cond_wait(&queue->changed, &queue->lock);
+
+    PGM *image = NULL;
+    if(queue->count > 0)
+    {
+        image = queue->images[queue->first];
+        queue->first = (queue->first + 1) % STREAM_DEPTH;
+        queue->count--;
+        pthread_cond_broadcast(&queue->changed);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return image;
+}
+
+/***********************************************************************
+ * Quantize every image of stdin with the same options and write the
+ * results to stdout, in the same order. Decoding of the next image
+ * overlaps the quantization and writing of the current one. The errors
+ * are printed on stderr, as stdout carries the images.
+ *
+ * PAREMETERS
+ * options      A valid pointer to the options (single number of levels,
+ *              not OUTPUT_INDEX)
+ *
+ * RETURN
+ * EXIT_SUCCESS If no error
+ * EXIT_FAILURE Otherwise (the images before the error are written)
+ ***********************************************************************/
+static int compressStream(const CompressionOptions *options)
+{
+    ImageQueue queue = {stdin, {NULL}, 0, 0, false, 0, false,
+                        PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER};
+    pthread_t reader;
+    if(pthread_create(&reader, NULL, streamReader, &queue) != 0)
+    {
+        fprintf(stderr, "Aborting; cannot start the reader thread\n");
+        return EXIT_FAILURE;
+    }
+
+    int status = EXIT_SUCCESS;
+    size_t index = 0;
+    PGM *image;
+    while(status == EXIT_SUCCESS && (image = nextImage(&queue)))
+    {
+        const ErrorMetric *metric = &options->constraints.metric;
+        bool fewWeights = metric->weights
+                          && metric->length < (size_t)image->maxValue+1;
+        Compression compression = {NULL, DBL_MAX, {NULL}, DBL_MAX};
+        if(!fewWeights)
+            compression = compressImage(image, NULL, options);
+        if(compression.compressed != image)
+            freeImage(image);
+
+        if(!compression.compressed)
+        {
+            fprintf(stderr, "Aborting; error while computing the reduction "
+                            "of image %zu%s\n", index,
+                    fewWeights ? " (less weights than gray levels)" : "");
+            status = EXIT_FAILURE;
+            break;
+        }
+
+        fprintf(stderr, "Image %zu: compression error: %lf\n", index,
+                compression.error);
+        if(metric->weights || metric->norm != NORM_L2)
+            fprintf(stderr, "Image %zu: metric error: %lf\n", index,
+                    compression.metricError);
+
+        // Flushed so that each image goes down the pipe as soon as ready
+        if(writeImage(stdout, compression.compressed) != 0
+           || fflush(stdout) != 0)
+        {
+            fprintf(stderr, "Aborting; error while writing image %zu\n",
+                    index);
+            status = EXIT_FAILURE;
+        }
+        freeImage(compression.compressed);
+        index++;
+    }
+
+    // Release the reader if it waits for room, and drop what is left
+    pthread_mutex_lock(&queue.lock);
+    queue.stopped = true;
+    pthread_cond_broadcast(&queue.changed);
+    pthread_mutex_unlock(&queue.lock);
+    pthread_join(reader, NULL);
+    for(size_t i=0; i<queue.count; i++)
+        freeImage(queue.images[(queue.first + i) % STREAM_DEPTH]);
+
+    if(status == EXIT_SUCCESS && queue.status != 0)
+    {
+        fprintf(stderr, "Aborting; error while reading image %zu\n",
+                index);
+        status = EXIT_FAILURE;
+    }
+    return status;
+}
+
+
+
+/*-----------------------------------------------------------------------------+
+|                                  MAIN                                        |
++-----------------------------------------------------------------------------*/
+/***********************************************************************
+ * Print the usage of the program on stderr.
+ *
+ * PAREMETERS
+ * name       Name of the executable
+ ***********************************************************************/
+static void usage(const char *name)
+{
+    /*
+     * name: name of the executable
+     * -s:   (optional) sample rate of the histogram
+     * -i:   (optional) output the level indices instead of the levels
+     * -q:   (optional) optimality required from the solver
+     * -m:   (optional) memory limit, in MiB
+     * -t:   (optional) number of cores
+     * -e:   (optional) norm of the error
+     * -w:   (optional) weights of the gray levels
+     * -d:   (optional) time budget of the anytime solver
+     * -p:   (optional) progressive stream output
+     * -r:   (optional) decode a progressive stream
+     * then: name of the input file, number(s) of levels, name of the
+     *       output (or "-", number of levels, "-" for a stream)
+     */
+    fprintf(stderr, "Usage: %s [-s <sample rate>] [-i] "
+                    "[-q approximate|near|exact] [-m <MiB>] [-t <cores>] "
+                    "[-e l2|l1] [-w <weights file>] [-d <seconds>] [-p] "
+                    "<PGM/PPM input image> "
+                    "<unsgined int>[,<unsigned int>...] "
+                    "<PGM/PPM output name>\n"
+                    "       %s [options] - <unsigned int> - "
+                    "(images from stdin to stdout)\n"
+                    "       %s -r <progressive stream> <unsigned int> "
+                    "<PGM/PPM output name>\n", name, name, name);
+}
+
+/***********************************************************************
+ * Load the weights of a weighted metric: a text file holding one
+ * non-negative weight per gray level, from 0 to maxValue, separated by
+ * white spaces.
+ *
+ * PAREMETERS
+ * filename   The name of the file
+ * length     Receives the number of weights
+ *
+ * RETURN
+ * weights    The weights. They must be free with `free`
+ * NULL       In case of error
+ ***********************************************************************/
+static double* loadWeights(const char *filename, size_t *length)
+{
+    FILE *file = fopen(filename, "r");
+    if(!file)
+        return NULL;
+
+    size_t capacity = 256, n = 0;
+    double *weights = malloc(capacity * sizeof(double)), weight;
+    while(weights && fscanf(file, "%lf", &weight) == 1)
+    {
+        if(!(weight >= 0))
+            break;
+        if(n == capacity)
+        {
+            double *larger = realloc(weights, 2 * capacity * sizeof(double));
+            if(!larger)
+                break;
+            weights = larger;
+            capacity *= 2;
+        }
+        weights[n++] = weight;
+    }
+
+    // Everything must have been read
+    int valid = weights && n > 0 && feof(file);
+    fclose(file);
+    if(!valid)
+    {
+        free(weights);
+        return NULL;
+    }
+
+    *length = n;
+    return weights;
+}
+
+/***********************************************************************
+ * Parse a comma-separated list of numbers of levels ("4" or "2,4,8,16").
+ *
+ * PAREMETERS
+ * arg        The list
+ * levels     Receives the numbers of levels
+ * max        Maximum number of entries of `levels`
+ *
+ * RETURN
+ * count      The number of levels parsed, 0 in case of error
+ ***********************************************************************/
+static size_t parseLevels(const char *arg, size_t *levels, size_t max)
+{
+    size_t count = 0;
+    while(count < max)
+    {
+        int read = 0;
+        if(sscanf(arg, "%zu%n", &levels[count], &read) != 1)
+            return 0;
+        count++;
+        arg += read;
+        if(*arg == '\0')
+            return count;
+        if(*arg++ != ',')
+            return 0;
+    }
+    return 0;
+}
+
+/***********************************************************************
+ * Name of the output on `nLevels` levels of a fan-out compression:
+ * "_<nLevels>" is inserted before the extension of `name`
+ * ("lena.pgm" gives "lena_4.pgm").
+ *
+ * PAREMETERS
+ * name       The output name given on the command line
+ * nLevels    The number of levels of the output
+ *
+ * RETURN
+ * name       The name of the output. It must be free with `free`
+ * NULL       In case of error
+ ***********************************************************************/
+static char* fanOutName(const char *name, size_t nLevels)
+{
+    const char *slash = strrchr(name, '/');
+    const char *dot = strrchr(name, '.');
+    size_t stem = dot && (!slash || dot > slash) ? (size_t)(dot - name)
+                                                 : strlen(name);
+
+    size_t size = strlen(name) + 24;
+    char *output = malloc(size);
+    if(output)
+        snprintf(output, size, "%.*s_%zu%s", (int)stem, name, nLevels,
+                 name + stem);
+    return output;
+}
+
+/***********************************************************************
+ * Compress the image on each number of levels and save the outputs (see
+ * `compressImageFanOut` and `fanOutName`).
+ *
+ * PAREMETERS
+ * image        A valid pointer to the input image
+ * options      A valid pointer to the options
+ * levels       The `count` numbers of levels
+ * count        The number of outputs
+ * outputName   The output name given on the command line
+ *
+ * RETURN
+ * EXIT_SUCCESS If no error
+ * EXIT_FAILURE Otherwise
+ ***********************************************************************/
+static int fanOut(const PGM *image, const CompressionOptions *options,
+                  const size_t *levels, size_t count, const char *outputName)
+{
+    Compression compressions[MAX_OUTPUTS];
+    if(compressImageFanOut(image, options, levels, count,
+                           compressions) != 0)
+    {
+        fprintf(stderr, "Aborting; error while computing the reductions\n");
+        return EXIT_FAILURE;
+    }
+
+    int status = EXIT_SUCCESS;
+    for(size_t o=0; o<count; o++)
+    {
+        fprintf(stdout, "Compression error (k=%zu): %lf\n", levels[o],
+                compressions[o].error);
+        if(options->constraints.metric.weights
+           || options->constraints.metric.norm != NORM_L2)
+            fprintf(stdout, "Metric error (k=%zu): %lf\n", levels[o],
+                    compressions[o].metricError);
+
+        char *name = fanOutName(outputName, levels[o]);
+        if(status == EXIT_SUCCESS
+           && (!name || saveImageToFile(compressions[o].compressed,
+                                        name) != 0))
+        {
+            fprintf(stderr, "Aborting; error while saving output image in "
+                            "'%s'\n", name ? name : outputName);
+            status = EXIT_FAILURE;
+        }
+        free(name);
+        freeImage(compressions[o].compressed);
+    }
+
+    return status;
+}
+
+int main(int argc, char** argv)
+{
+    // Parse options
+    CompressionOptions options = {0, 1., OUTPUT_IN_PLACE,
+                                  {OPTIMALITY_NEAR_OPTIMAL, 0, 0, true,
+                                   {NORM_L2, NULL, 0}}, 0.};
+    const char *weightsName = NULL;
+    bool progressive = false, decode = false;
+    int arg = 1;
+    for(; arg < argc && argv[arg][0] == '-' && argv[arg][1] != '\0'; arg++)
+    {
+        if(strcmp(argv[arg], "-i") == 0)
+            options.mode = OUTPUT_INDEX;
+        else if(strcmp(argv[arg], "-p") == 0)
+            progressive = true;
+        else if(strcmp(argv[arg], "-r") == 0)
+            decode = true;
+        else if(strcmp(argv[arg], "-s") == 0 && arg+1 < argc)
+        {
+            if(sscanf(argv[++arg], "%lf", &options.sampleRate) != 1
+               || !(options.sampleRate > 0) || options.sampleRate > 1)
+            {
+                fprintf(stderr, "Aborting; sample rate should be in ]0, 1]. "
+                                "Got '%s'.\n", argv[arg]);
+                return EXIT_FAILURE;
+            }
+        }
+        else if(strcmp(argv[arg], "-e") == 0 && arg+1 < argc)
+        {
+            const char *norm = argv[++arg];
+            if(strcmp(norm, "l2") == 0)
+                options.constraints.metric.norm = NORM_L2;
+            else if(strcmp(norm, "l1") == 0)
+                options.constraints.metric.norm = NORM_L1;
+            else
+            {
+                fprintf(stderr, "Aborting; unknown error metric '%s'.\n",
+                        norm);
+                return EXIT_FAILURE;
+            }
+        }
+        else if(strcmp(argv[arg], "-d") == 0 && arg+1 < argc)
+        {
+            if(sscanf(argv[++arg], "%lf", &options.budget) != 1
+               || !(options.budget > 0))
+            {
+                fprintf(stderr, "Aborting; the time budget should be a "
+                                "positive number of seconds. Got '%s'.\n",
+                        argv[arg]);
+                return EXIT_FAILURE;
+            }
+        }
+        else if(strcmp(argv[arg], "-w") == 0 && arg+1 < argc)
+            weightsName = argv[++arg];
+        else if(strcmp(argv[arg], "-q") == 0 && arg+1 < argc)
+        {
+            const char *quality = argv[++arg];
+            if(strcmp(quality, "approximate") == 0)
+                options.constraints.optimality = OPTIMALITY_APPROXIMATE;
+            else if(strcmp(quality, "near") == 0)
+                options.constraints.optimality = OPTIMALITY_NEAR_OPTIMAL;
+            else if(strcmp(quality, "exact") == 0)
+                options.constraints.optimality = OPTIMALITY_EXACT;
+            else
+            {
+                fprintf(stderr, "Aborting; unknown optimality '%s'.\n",
+                        quality);
+                return EXIT_FAILURE;
+            }
+        }
+        else if((strcmp(argv[arg], "-m") == 0 || strcmp(argv[arg], "-t") == 0)
+                && arg+1 < argc)
+        {
+            size_t value = 0;
+            if(sscanf(argv[arg+1], "%zu", &value) != 1)
+            {
+                fprintf(stderr, "Aborting; %s should be followed by an "
+                                "unsigned int. Got '%s'.\n", argv[arg],
+                        argv[arg+1]);
+                return EXIT_FAILURE;
+            }
+            if(argv[arg][1] == 'm')
+                options.constraints.memoryLimit = value << 20;
+            else
+                options.constraints.cores = value;
+            arg++;
+        }
+        else
+        {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Checking arguments
+    if (argc - arg != 3)
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    const char *inputName = argv[arg];
+    const char *levelsArg = argv[arg+1];
+    const char *outputName = argv[arg+2];
+
+    // Parse arguments
+    size_t levels[MAX_OUTPUTS];
+    size_t count = parseLevels(levelsArg, levels, MAX_OUTPUTS);
+    if(count == 0)
+    {
+        fprintf(stderr, "Aborting; number of levels should be unsigned int "
+                        "(or a list of at most %d of them, separated by "
+                        "commas). Got '%s'.\n", MAX_OUTPUTS, levelsArg);
+        return EXIT_FAILURE;
+    }
+    if(count > 1 && options.mode == OUTPUT_INDEX)
+    {
+        fprintf(stderr, "Aborting; -i takes a single number of levels.\n");
+        return EXIT_FAILURE;
+    }
+    options.nLevels = levels[0];
+
+    // Progressive streams
+    if(decode)
+        return decodeProgressive(inputName, levels[0], outputName);
+    size_t depth = levelsDepth(levels[0]);
+    if(progressive && (count > 1 || depth == 0
+                       || options.mode == OUTPUT_INDEX
+                       || options.sampleRate < 1 || options.budget > 0))
+    {
+        fprintf(stderr, "Aborting; -p takes a single power of two (at most "
+                        "%d) as number of levels, and no -i, -s or -d.\n",
+                1 << MAX_NESTED_DEPTH);
+        return EXIT_FAILURE;
+    }
+
+    // Load the weights of the metric
+    double *weights = NULL;
+    if(weightsName)
+    {
+        weights = loadWeights(weightsName, &options.constraints.metric.length);
+        if(!weights)
+        {
+            fprintf(stderr, "Aborting; error while loading the weights "
+                            "'%s'\n", weightsName);
+            return EXIT_FAILURE;
+        }
+        options.constraints.metric.weights = weights;
+    }
+
+    // Stream of images from stdin to stdout
+    bool streamInput = strcmp(inputName, "-") == 0;
+    if(streamInput || strcmp(outputName, "-") == 0)
+    {
+        int status = EXIT_FAILURE;
+        if(!streamInput || strcmp(outputName, "-") != 0)
+            fprintf(stderr, "Aborting; \"-\" must be both the input and "
+                            "the output.\n");
+        else if(count > 1 || options.mode == OUTPUT_INDEX || progressive)
+            fprintf(stderr, "Aborting; a stream takes a single number of "
+                            "levels and no -i or -p.\n");
+        else
+            status = compressStream(&options);
+        free(weights);
+        return status;
+    }
+
+    // Load input Image (in parallel, with its histograms when a single
+    // compression will use them)
+    Histogram *hists[MAX_CHANNELS] = {NULL};
+    bool withHistograms = count == 1 && !progressive
+                          && options.sampleRate >= 1;
+    PGM* inputImg = loadImage(inputName, options.constraints.cores,
+                              withHistograms ? hists : NULL);
+    if(!inputImg || (weights && options.constraints.metric.length
+                                < (size_t)inputImg->maxValue+1))
+    {
+        fprintf(stderr, "Aborting; error while loading input image '%s'%s\n",
+                inputName, inputImg ? " (less weights than gray levels)" : "");
+        for(size_t c=0; c<MAX_CHANNELS; c++)
+            freeHistogram(hists[c]);
+        freeImage(inputImg);
+        free(weights);
+        return EXIT_FAILURE;
+    }
+
+    if(progressive)
+    {
+        int status = compressProgressive(inputImg, &options, depth,
+                                         outputName);
+        freeImage(inputImg);
+        free(weights);
+        return status;
+    }
+
+    // Several numbers of levels: one output each, the input is kept
+    if(count > 1)
+    {
+        options.mode = OUTPUT_COPY;
+        int status = fanOut(inputImg, &options, levels, count, outputName);
+        freeImage(inputImg);
+        free(weights);
+        return status;
+    }
+
+    // Compress (the input image is not needed afterwards: overwrite it
+    // unless the index image is requested)
+    Compression compression = compressImage(inputImg,
+                                             withHistograms ? hists : NULL,
+                                             &options);
+    PGM* outputImg = compression.compressed;
+    free(weights);
+    if(!outputImg)
+    {
+        fprintf(stderr, "Aborting; error while computing the reduction\n");
+        freeImage(inputImg);
+        return EXIT_FAILURE;
+    }
+    if(outputImg != inputImg)
+        freeImage(inputImg);
+
+    fprintf(stdout, "Compression error: %lf\n", compression.error);
+    if(weightsName || options.constraints.metric.norm != NORM_L2)
+        fprintf(stdout, "Metric error: %lf\n", compression.metricError);
+    for(size_t c=0; c<MAX_CHANNELS && compression.palettes[c]; c++)
+    {
+        fprintf(stdout, "Palette:");
+        for(size_t i=0; i<compression.palettes[c]->nLevels; i++)
+            fprintf(stdout, " %u", compression.palettes[c]->levels[i]);
+        fprintf(stdout, "\n");
+        freeMapping(compression.palettes[c]);
+    }
+
+
+    // Save output image
+    if(saveImageToFile(outputImg, outputName) != 0)
+    {
+        fprintf(stderr, "Aborting; error while saving output image in '%s'\n",
+                outputName);
+        freeImage(outputImg);
+        return EXIT_FAILURE;
+    }
+
+    freeImage(outputImg);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,474 @@
+/***********************************************************************
+ * Optimal and coarse-to-fine mappings by dynamic programming on the
+ * prefix sums of the histogram.
+ *
+ * A mapping on k levels is given by its boundaries
+ * 0 = p_0 < p_1 < ... < p_k = n; its error is the sum of the errors of
+ * the intervals [p_{i-1}, p_i), each evaluated in O(1) with
+ * `intervalError`. The dynamic program chooses each p_i among a set of
+ * candidate positions:
+ * - every position for the exact solver: O(k n^2), or O(k d^2) when only
+ *   d bins are non-empty,
+ * - multiples of n/coarseLength for the coarse solve, then a window of
+ *   +/- `window` values around each coarse boundary for the refinement:
+ *   O(k coarseLength^2 + k window^2).
+ * With the L1 metric, each interval error costs O(log n) instead of O(1).
+ ***********************************************************************/
+#include <stdlib.h>
+#include <float.h>
+
+#include "compression.h"
+
+/* Candidate positions of one boundary: lo, lo+step, ..., up to hi */
+typedef struct
+{
+    size_t lo;
+    size_t hi;
+    size_t step;
+
+} Candidates;
+
+static inline size_t candidateCount(const Candidates *candidates)
+{
+    if(candidates->hi < candidates->lo)
+        return 0;
+    return (candidates->hi - candidates->lo) / candidates->step + 1;
+}
+
+static inline size_t candidateAt(const Candidates *candidates, size_t i)
+{
+    return candidates->lo + i * candidates->step;
+}
+
+
+
+/***********************************************************************
+ * Find the boundaries p_1 < ... < p_{k-1} minimizing the error, with
+ * p_i among `candidates[i-1]`.
+ *
+ * PARAMETERS
+ * cumulative   A valid pointer to a CumulativeHistogram
+ * k            The number of levels (1 <= k <= length)
+ * candidates   The k-1 candidate sets
+ * boundaries   Receives p_1, ..., p_{k-1}
+ * arena        Temporary memory (given back on return), NULL for the heap
+ *
+ * RETURN
+ * error        The error of the best boundaries, DBL_MAX in case of error
+ ***********************************************************************/
+static double solveCandidates(const CumulativeHistogram *cumulative,
+                              size_t k, const Candidates *candidates,
+                              size_t *boundaries, Arena *arena)
+{
+    size_t n = cumulative->length;
+    if(k == 1)
+        return intervalError(cumulative, 0, n, NULL);
+
+    // offsets[i]: start of the layer of boundary p_{i+1} in the tables
+    size_t mark = arena ? arena->used : 0;
+    size_t *offsets = arenaAlloc(arena, k * sizeof(size_t));
+    if(!offsets)
+        return DBL_MAX;
+    offsets[0] = 0;
+    for(size_t i=1; i<k; i++)
+        offsets[i] = offsets[i-1] + candidateCount(&candidates[i-1]);
+
+    size_t total = offsets[k-1];
+    double *value = arenaAlloc(arena, (total > 0 ? total : 1)
+                                      * sizeof(double));
+    size_t *choice = arenaAlloc(arena, (total > 0 ? total : 1)
+                                       * sizeof(size_t));
+    if(!value || !choice)
+    {
+        arenaFree(arena, offsets);
+        arenaFree(arena, value);
+        arenaFree(arena, choice);
+        if(arena)
+            arena->used = mark;
+        return DBL_MAX;
+    }
+
+    // First boundary: a single interval [0, p_1)
+    for(size_t x=0; x<candidateCount(&candidates[0]); x++)
+    {
+        size_t p = candidateAt(&candidates[0], x);
+        value[x] = p > 0 ? intervalError(cumulative, 0, p, NULL) : DBL_MAX;
+        choice[x] = 0;
+    }
+
+    // Next boundaries: best previous boundary strictly before
+    for(size_t i=1; i<k-1; i++)
+    {
+        const Candidates *prev = &candidates[i-1], *cur = &candidates[i];
+        const double *prevValue = value + offsets[i-1];
+        double *curValue = value + offsets[i];
+        size_t *curChoice = choice + offsets[i];
+
+        for(size_t x=0; x<candidateCount(cur); x++)
+        {
+            size_t p = candidateAt(cur, x);
+            double best = DBL_MAX;
+            size_t bestY = 0;
+            for(size_t y=0; y<candidateCount(prev); y++)
+            {
+                size_t q = candidateAt(prev, y);
+                if(q >= p)
+                    break;
+                if(prevValue[y] == DBL_MAX)
+                    continue;
+                double v = prevValue[y]
+                         + intervalError(cumulative, q, p, NULL);
+                if(v < best)
+                {
+                    best = v;
+                    bestY = y;
+                }
+            }
+            curValue[x] = best;
+            curChoice[x] = bestY;
+        }
+    }
+
+    // Last interval [p_{k-1}, n)
+    const Candidates *last = &candidates[k-2];
+    const double *lastValue = value + offsets[k-2];
+    double best = DBL_MAX;
+    size_t bestX = 0;
+    for(size_t x=0; x<candidateCount(last); x++)
+    {
+        size_t p = candidateAt(last, x);
+        if(p >= n || lastValue[x] == DBL_MAX)
+            continue;
+        double v = lastValue[x] + intervalError(cumulative, p, n, NULL);
+        if(v < best)
+        {
+            best = v;
+            bestX = x;
+        }
+    }
+
+    // Backtrack
+    if(best != DBL_MAX)
+        for(size_t i=k-1; i>0; i--)
+        {
+            boundaries[i-1] = candidateAt(&candidates[i-1], bestX);
+            bestX = choice[offsets[i-1] + bestX];
+        }
+
+    arenaFree(arena, offsets);
+    arenaFree(arena, value);
+    arenaFree(arena, choice);
+    if(arena)
+        arena->used = mark;
+    return best;
+}
+
+
+
+/***********************************************************************
+ * Solve with every position as candidate, on min(nLevels, length)
+ * levels. The mapping is allocated from `arena` (NULL for the heap).
+ ***********************************************************************/
+static Mapping* solveExact(const CumulativeHistogram *cumulative,
+                           size_t nLevels, Arena *arena)
+{
+    size_t n = cumulative->length;
+    size_t k = nLevels < n ? nLevels : n;
+
+    Candidates *candidates = arenaAlloc(arena, k * sizeof(Candidates));
+    size_t *boundaries = arenaAlloc(arena, k * sizeof(size_t));
+    Mapping *mapping = NULL;
+    if(candidates && boundaries)
+    {
+        for(size_t i=1; i<k; i++)
+            candidates[i-1] = (Candidates){i, n-k+i, 1};
+
+        if(solveCandidates(cumulative, k, candidates, boundaries,
+                           arena) != DBL_MAX)
+            mapping = createMappingFromBoundariesInArena(arena, cumulative,
+                                                         boundaries, k,
+                                                         nLevels);
+    }
+
+    arenaFree(arena, candidates);
+    arenaFree(arena, boundaries);
+    return mapping;
+}
+
+CumulativeHistogram* createCompactCumulative(
+    const CumulativeHistogram *full, size_t distinct, Arena *arena)
+{
+    CumulativeHistogram *cumulative = arenaAlloc(arena,
+                                                 sizeof(CumulativeHistogram));
+    unsigned long long *count = arenaAlloc(arena, (distinct+1)
+                                           * sizeof(unsigned long long));
+    long double *sum = arenaAlloc(arena, (distinct+1) * sizeof(long double));
+    long double *sumSquares = arenaAlloc(arena, (distinct+1)
+                                                * sizeof(long double));
+    long double *weight = full->weight
+        ? arenaAlloc(arena, (distinct+1) * sizeof(long double)) : NULL;
+    size_t *values = arenaAlloc(arena, distinct * sizeof(size_t));
+    if(!cumulative || !count || !sum || !sumSquares || !values
+       || (full->weight && !weight))
+    {
+        arenaFree(arena, cumulative);
+        arenaFree(arena, count);
+        arenaFree(arena, sum);
+        arenaFree(arena, sumSquares);
+        arenaFree(arena, weight);
+        arenaFree(arena, values);
+        return NULL;
+    }
+
+    // Entry j+1 is the full prefix just after the j-th non-empty bin
+    count[0] = 0;
+    sum[0] = sumSquares[0] = 0;
+    if(weight)
+        weight[0] = 0;
+    size_t j = 0;
+    for(size_t i=0; i<full->length; i++)
+    {
+        if(full->count[i+1] == full->count[i])
+            continue;
+        values[j] = i;
+        count[j+1] = full->count[i+1];
+        sum[j+1] = full->sum[i+1];
+        sumSquares[j+1] = full->sumSquares[i+1];
+        if(weight)
+            weight[j+1] = full->weight[i+1];
+        j++;
+    }
+
+    cumulative->length = distinct;
+    cumulative->count = count;
+    cumulative->sum = sum;
+    cumulative->sumSquares = sumSquares;
+    cumulative->norm = full->norm;
+    cumulative->weight = weight;
+    cumulative->values = values;
+    return cumulative;
+}
+
+/*
+ * Moving a boundary across empty bins changes neither the levels nor the
+ * error, so the exact solver runs on the d non-empty bins: O(k d^2).
+ */
+Mapping* exactMapping(const CumulativeHistogram *cumulative, size_t nLevels,
+                      Arena *arena)
+{
+    if(!cumulative || cumulative->length == 0 || nLevels == 0)
+        return NULL;
+
+    size_t n = cumulative->length, distinct = 0;
+    for(size_t i=0; i<n; i++)
+        distinct += cumulative->count[i+1] != cumulative->count[i];
+
+    // Nothing to compact
+    if(distinct == 0 || distinct == n || cumulative->values)
+        return solveExact(cumulative, nLevels, arena);
+
+    CumulativeHistogram *compact = createCompactCumulative(cumulative,
+                                                           distinct, arena);
+    Mapping *mapping = compact ? solveExact(compact, nLevels, arena) : NULL;
+
+    // Back from compact indices to gray values
+    if(mapping)
+        for(size_t i=0; i<mapping->nLevels; i++)
+            mapping->thresholds[i] = mapping->thresholds[i] < distinct
+                                   ? compact->values[mapping->thresholds[i]]
+                                   : n;
+
+    freeCumulativeHistogramInArena(arena, compact);
+    return mapping;
+}
+
+Mapping* computeMappingExact(const Histogram *histogram, size_t nLevels)
+{
+    CumulativeHistogram *cumulative = createCumulativeHistogram(histogram);
+    if(!cumulative)
+        return NULL;
+
+    Mapping *mapping = exactMapping(cumulative, nLevels, NULL);
+    freeCumulativeHistogram(cumulative);
+    return mapping;
+}
+
+
+
+/***********************************************************************
+ * One refinement pass: each boundary is solved again within +/- `window`
+ * of its position, with `candidates` holding k-1 entries. `*settled` is
+ * set to whether no boundary ended on the border of its window. Returns
+ * the error of the refined boundaries, DBL_MAX in case of error.
+ ***********************************************************************/
+static double refinePass(const CumulativeHistogram *cumulative, size_t k,
+                         size_t window, Candidates *candidates,
+                         size_t *boundaries, bool *settled, Arena *arena)
+{
+    size_t n = cumulative->length;
+    for(size_t i=1; i<k; i++)
+    {
+        size_t b = boundaries[i-1];
+        size_t lo = b > i + window ? b - window : i;
+        size_t hi = b + window < n-k+i ? b + window : n-k+i;
+        candidates[i-1] = (Candidates){lo, hi, 1};
+    }
+    double error = solveCandidates(cumulative, k, candidates, boundaries,
+                                   arena);
+
+    *settled = true;
+    for(size_t i=1; i<k; i++)
+    {
+        size_t b = boundaries[i-1];
+        if((b == candidates[i-1].lo && b > i)
+           || (b == candidates[i-1].hi && b < n-k+i))
+            *settled = false;
+    }
+    return error;
+}
+
+/***********************************************************************
+ * Refinement passes of `refineBoundaries`, with `candidates` holding k-1
+ * entries. Returns the error of the refined boundaries, DBL_MAX in case
+ * of error.
+ ***********************************************************************/
+static double refineInWindows(const CumulativeHistogram *cumulative,
+                              size_t k, size_t window, Candidates *candidates,
+                              size_t *boundaries, Arena *arena)
+{
+    double error = DBL_MAX;
+
+    // A boundary ending on the border of its window may still move:
+    // re-centre and solve again
+    bool settled = false;
+    for(size_t pass=0; pass<MAX_REFINEMENTS && !settled; pass++)
+    {
+        error = refinePass(cumulative, k, window, candidates, boundaries,
+                           &settled, arena);
+        if(error == DBL_MAX)
+            return DBL_MAX;
+    }
+
+    return error;
+}
+
+double refineBoundaries(const CumulativeHistogram *cumulative, size_t k,
+                        size_t window, size_t *boundaries, Arena *arena)
+{
+    if(!cumulative || k == 0 || k > cumulative->length
+       || (k > 1 && !boundaries))
+        return DBL_MAX;
+
+    size_t n = cumulative->length;
+    if(window == 0 || k == 1)
+    {
+        double error = 0;
+        for(size_t i=0, begin=0; i<k; i++)
+        {
+            size_t end = i+1 < k ? boundaries[i] : n;
+            error += intervalError(cumulative, begin, end, NULL);
+            begin = end;
+        }
+        return error;
+    }
+
+    size_t mark = arena ? arena->used : 0;
+    Candidates *candidates = arenaAlloc(arena, k * sizeof(Candidates));
+    double error = candidates
+        ? refineInWindows(cumulative, k, window, candidates, boundaries,
+                          arena)
+        : DBL_MAX;
+
+    arenaFree(arena, candidates);
+    if(arena)
+        arena->used = mark;
+    return error;
+}
+
+double refineBoundariesOnce(const CumulativeHistogram *cumulative, size_t k,
+                            size_t window, size_t *boundaries, bool *settled,
+                            Arena *arena)
+{
+    if(!cumulative || k == 0 || k > cumulative->length || !settled
+       || (k > 1 && !boundaries))
+        return DBL_MAX;
+    if(window == 0 || k == 1)
+    {
+        *settled = true;
+        return refineBoundaries(cumulative, k, 0, boundaries, arena);
+    }
+
+    size_t mark = arena ? arena->used : 0;
+    Candidates *candidates = arenaAlloc(arena, k * sizeof(Candidates));
+    double error = candidates
+        ? refinePass(cumulative, k, window, candidates, boundaries, settled,
+                     arena)
+        : DBL_MAX;
+
+    arenaFree(arena, candidates);
+    if(arena)
+        arena->used = mark;
+    return error;
+}
+
+
+
+Mapping* coarseToFineMapping(const CumulativeHistogram *cumulative,
+                             size_t nLevels, size_t coarseLength,
+                             size_t window, Arena *arena)
+{
+    if(!cumulative || cumulative->length == 0 || nLevels == 0)
+        return NULL;
+
+    size_t n = cumulative->length;
+    size_t k = nLevels;
+    if(coarseLength < k)
+        coarseLength = k;
+    size_t factor = n / coarseLength;
+
+    // Coarsening would not save anything
+    if(factor <= 1 || k == 1)
+        return solveExact(cumulative, nLevels, arena);
+
+    Candidates *candidates = arenaAlloc(arena, k * sizeof(Candidates));
+    size_t *boundaries = arenaAlloc(arena, k * sizeof(size_t));
+    Mapping *mapping = NULL;
+    if(!candidates || !boundaries)
+        goto cleanup;
+
+    // Coarse solve: boundaries on multiples of `factor` (n >= k * factor,
+    // so every set is non-empty); the errors are still exact
+    for(size_t i=1; i<k; i++)
+        candidates[i-1] = (Candidates){i * factor,
+                                       (n - (k-i)) / factor * factor, factor};
+    if(solveCandidates(cumulative, k, candidates, boundaries,
+                       arena) == DBL_MAX)
+        goto cleanup;
+
+    // Refinement at full resolution in a window around each boundary
+    if(window > 0 && refineInWindows(cumulative, k, window, candidates,
+                                     boundaries, arena) == DBL_MAX)
+        goto cleanup;
+
+    mapping = createMappingFromBoundariesInArena(arena, cumulative, boundaries,
+                                                 k, nLevels);
+
+cleanup:
+    arenaFree(arena, candidates);
+    arenaFree(arena, boundaries);
+    return mapping;
+}
+
+Mapping* computeMappingCoarseToFine(const Histogram *histogram,
+                                    size_t nLevels, size_t coarseLength,
+                                    size_t window)
+{
+    CumulativeHistogram *cumulative = createCumulativeHistogram(histogram);
+    if(!cumulative)
+        return NULL;
+
+    Mapping *mapping = coarseToFineMapping(cumulative, nLevels, coarseLength,
+                                           window, NULL);
+    freeCumulativeHistogram(cumulative);
+    return mapping;
+}
@@ -0,0 +1,186 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "perf_counters.h"
+
+static const char *counterNames[NUM_COUNTERS] = {"cycles", "instructions",
+                                                 "l1d_misses", "llc_misses",
+                                                 "branch_misses"};
+
+static double now(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+
+
+#ifdef __linux__
+/* Type and configuration of each counter for perf_event_open */
+static void counterEvent(Counter counter, struct perf_event_attr *attr)
+{
+    static const uint64_t l1dReadMiss = PERF_COUNT_HW_CACHE_L1D
+        | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+        | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+
+    attr->type = PERF_TYPE_HARDWARE;
+    switch(counter)
+    {
+        case COUNTER_CYCLES:
+            attr->config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case COUNTER_INSTRUCTIONS:
+            attr->config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case COUNTER_L1D_MISSES:
+            attr->type = PERF_TYPE_HW_CACHE;
+            attr->config = l1dReadMiss;
+            break;
+        case COUNTER_LLC_MISSES:
+            attr->config = PERF_COUNT_HW_CACHE_MISSES;
+            break;
+        default:
+            attr->config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+    }
+}
+
+static int openCounter(Counter counter)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    counterEvent(counter, &attr);
+    attr.disabled = 1;
+    attr.inherit = 1;           // Threads created while counting
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED
+                     | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    long fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    return fd >= 0 ? (int)fd : -1;
+}
+#endif
+
+PerfCounters* createPerfCounters(void)
+{
+    PerfCounters *counters = malloc(sizeof(PerfCounters));
+    if(!counters)
+        return NULL;
+
+    for(int c=0; c<NUM_COUNTERS; c++)
+    {
+#ifdef __linux__
+        counters->fds[c] = openCounter((Counter)c);
+#else
+        counters->fds[c] = -1;
+#endif
+    }
+
+    return counters;
+}
+
+
+
+void freePerfCounters(PerfCounters *counters)
+{
+    if(!counters) return;
+    for(int c=0; c<NUM_COUNTERS; c++)
+        if(counters->fds[c] >= 0)
+            close(counters->fds[c]);
+    free(counters);
+}
+
+
+
+int availableCounters(const PerfCounters *counters)
+{
+    int available = 0;
+    for(int c=0; counters && c<NUM_COUNTERS; c++)
+        available += counters->fds[c] >= 0;
+    return available;
+}
+
+
+
+void startCounters(PerfCounters *counters, PerfSample *sample)
+{
+    for(int c=0; c<NUM_COUNTERS; c++)
+    {
+        sample->values[c] = 0;
+        sample->valid[c] = false;
+#ifdef __linux__
+        if(counters && counters->fds[c] >= 0)
+        {
+            ioctl(counters->fds[c], PERF_EVENT_IOC_RESET, 0);
+            ioctl(counters->fds[c], PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    // Last, so that opening the counters is not timed
+    sample->seconds = now();
+}
+
+
+
+void stopCounters(PerfCounters *counters, PerfSample *sample)
+{
+    sample->seconds = now() - sample->seconds;
+
+#ifdef __linux__
+    for(int c=0; counters && c<NUM_COUNTERS; c++)
+    {
+        if(counters->fds[c] < 0)
+            continue;
+        ioctl(counters->fds[c], PERF_EVENT_IOC_DISABLE, 0);
+
+        // value, time enabled, time running
+        uint64_t data[3];
+        if(read(counters->fds[c], data, sizeof(data)) != sizeof(data)
+           || data[2] == 0)
+            continue;
+
+        // Scale the counters that were multiplexed
+        double scale = data[2] < data[1] ? (double)data[1] / data[2] : 1.;
+        sample->values[c] = (unsigned long long)(data[0] * scale);
+        sample->valid[c] = true;
+    }
+#else
+    (void)counters;
+#endif
+}
+
+
+
+void printCountersHeader(FILE *stream)
+{
+    for(int c=0; c<NUM_COUNTERS; c++)
+        fprintf(stream, "%s%s", c > 0 ? "," : "", counterNames[c]);
+}
+
+void printCounters(FILE *stream, const PerfSample *sample)
+{
+    for(int c=0; c<NUM_COUNTERS; c++)
+    {
+        if(c > 0)
+            fputc(',', stream);
+        if(sample->valid[c])
+            fprintf(stream, "%llu", sample->values[c]);
+        else
+            fputs("NA", stream);
+    }
+}
@@ -0,0 +1,102 @@
+/***********************************************************************
+ * Hardware performance counters of the calling thread (and the threads
+ * it creates while counting), read with perf_event_open on Linux.
+ *
+ * Each counter is opened on its own: the ones the kernel, the CPU or the
+ * container do not provide are simply reported as unavailable, and
+ * counting never fails (on other systems, no counter is available).
+ * Counters multiplexed by the kernel are scaled to the whole run.
+ ***********************************************************************/
+
+#ifndef _PERF_COUNTERS_H_
+#define _PERF_COUNTERS_H_
+
+#include <stdbool.h>
+#include <stdio.h>
+
+typedef enum
+{
+    COUNTER_CYCLES,
+    COUNTER_INSTRUCTIONS,
+    COUNTER_L1D_MISSES,         // L1 data cache read misses
+    COUNTER_LLC_MISSES,         // Last level cache misses
+    COUNTER_BRANCH_MISSES,
+    NUM_COUNTERS
+
+} Counter;
+
+typedef struct
+{
+    int fds[NUM_COUNTERS];      // -1 for the unavailable counters
+
+} PerfCounters;
+
+/* What was counted between `startCounters` and `stopCounters` */
+typedef struct
+{
+    double seconds;                         // Wall-clock time
+    unsigned long long values[NUM_COUNTERS];
+    bool valid[NUM_COUNTERS];               // false if not counted
+
+} PerfSample;
+
+
+/***********************************************************************
+ * Open the counters.
+ *
+ * RETURN
+ * counters     A pointer to PerfCounters (possibly without any available
+ *              counter). It must be deleted by calling `freePerfCounters`
+ * NULL         In case of error (out of memory)
+ ***********************************************************************/
+PerfCounters* createPerfCounters(void);
+
+
+/***********************************************************************
+ * Close the counters
+ *
+ * PAREMETERS
+ * counters     A pointer to PerfCounters
+ ***********************************************************************/
+void freePerfCounters(PerfCounters *counters);
+
+
+/***********************************************************************
+ * Number of available counters.
+ ***********************************************************************/
+int availableCounters(const PerfCounters *counters);
+
+
+/***********************************************************************
+ * Reset and start the counters, and the clock of the sample.
+ *
+ * PARAMETERS
+ * counters     A pointer to PerfCounters, NULL to only measure the time
+ * sample       Receives the start time
+ ***********************************************************************/
+void startCounters(PerfCounters *counters, PerfSample *sample);
+
+
+/***********************************************************************
+ * Stop the counters and read them.
+ *
+ * PARAMETERS
+ * counters     The counters given to `startCounters`
+ * sample       The sample given to `startCounters`, receiving the time
+ *              and the counts
+ ***********************************************************************/
+void stopCounters(PerfCounters *counters, PerfSample *sample);
+
+
+/***********************************************************************
+ * Print the CSV header of the counters (without the time) or the values
+ * of a sample, comma-separated, "NA" for the unavailable counters.
+ *
+ * PARAMETERS
+ * stream       The output stream
+ * sample       A valid pointer to a PerfSample
+ ***********************************************************************/
+void printCountersHeader(FILE *stream);
+void printCounters(FILE *stream, const PerfSample *sample);
+
+#endif // !_PERF_COUNTERS_H_
@@ -0,0 +1,274 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "planner.h"
+#include "compression.h"
+
+/*
+ * Cost model, calibrated with timeit (build of commande.txt):
+ * - a step of the dynamic programming (one `intervalError`),
+ * - a bin of the histogram (prefix sums, binary search step),
+ * - a sample of the image (remap).
+ * A DP on k levels and m candidates per boundary makes about
+ * (k-2) m^2 / 2 steps: the first and last boundaries only cost m each.
+ */
+#define NS_PER_DP_STEP 180.
+#define NS_PER_BIN 3.
+#define NS_PER_SAMPLE 1.
+
+// Coarse resolution of SOLVER_COARSE_TO_FINE
+#define COARSE_LENGTH 256
+// Refinement passes assumed by the model (the solver does at most 8)
+#define EXPECTED_REFINEMENTS 2
+
+static const char *solverNames[] = {"equal-population", "coarse-to-fine",
+                                    "exact"};
+
+/* Quality guaranteed by each solver */
+static const Optimality solverOptimality[] = {OPTIMALITY_APPROXIMATE,
+                                              OPTIMALITY_NEAR_OPTIMAL,
+                                              OPTIMALITY_EXACT};
+
+
+
+PlanInput planInput(Histogram *const *hists, size_t channels, size_t nLevels,
+                    size_t pixels, size_t bytesPerSample, bool indexOutput)
+{
+    PlanInput input = {0, 0, nLevels, pixels, channels, bytesPerSample,
+                       indexOutput};
+
+    for(size_t c=0; c<channels; c++)
+    {
+        size_t distinct = 0;
+        for(size_t i=0; i<hists[c]->length; i++)
+            distinct += hists[c]->count[i] != 0;
+
+        if(hists[c]->length > input.length)
+            input.length = hists[c]->length;
+        if(distinct > input.distinct)
+            input.distinct = distinct;
+    }
+
+    return input;
+}
+
+
+
+/* Steps of a DP on k levels with m candidates per boundary */
+static double dpSteps(double k, double m)
+{
+    return k > 2 ? (k - 2) * m * m / 2 + 2 * m : k * m;
+}
+
+/* Width of the coarse bins of SOLVER_COARSE_TO_FINE */
+static size_t coarseFactor(const PlanInput *input)
+{
+    size_t coarse = input->nLevels > COARSE_LENGTH ? input->nLevels
+                                                  : COARSE_LENGTH;
+    return input->length / coarse;
+}
+
+/***********************************************************************
+ * Estimated time (seconds) and memory (bytes) of solving one histogram.
+ ***********************************************************************/
+static void estimateSolver(const PlanInput *input, Plan *plan,
+                           double *time, size_t *memory)
+{
+    double n = input->length, d = input->distinct, k = input->nLevels;
+    double prefixBytes = 40. * (n + 1);     // count, sum, sumSquares
+    double steps = 0, bins = n, bytes = prefixBytes;
+    if(plan->metric.weights)
+        bytes += 16. * (n + 1);             // weight
+
+    switch(plan->solver)
+    {
+        case SOLVER_EQUAL_POPULATION:
+            bins += k * log2(n + 1);
+            break;
+
+        case SOLVER_COARSE_TO_FINE:
+        {
+            double coarse = floor(n / coarseFactor(input));
+            double width = 2. * plan->window + 1;
+            steps = dpSteps(k, coarse)
+                  + EXPECTED_REFINEMENTS * k * width * width;
+            bytes += 16. * k * fmax(coarse, width);
+            break;
+        }
+
+        case SOLVER_EXACT:
+            // On the non-empty bins only (compact prefix sums + values);
+            // a sweep for 2 levels, a divide and conquer for 3
+            bytes += 48. * (d + 1);
+            if(k <= FEW_LEVELS_MAX)
+            {
+                steps = k < FEW_LEVELS_MAX ? 2 * d : d * log2(d + 1);
+                bytes += 24. * (d + 1);
+                break;
+            }
+            steps = dpSteps(k, d);
+            bytes += 16. * k * d;
+            break;
+    }
+
+    // An L1 interval error is a binary search
+    if(plan->metric.norm == NORM_L1)
+        steps *= log2(n + 1);
+
+    *time = (bins * NS_PER_BIN + steps * NS_PER_DP_STEP) * 1e-9;
+    *memory = (size_t)bytes;
+}
+
+/***********************************************************************
+ * Complete the estimates of a plan whose solver, parameters, threads and
+ * output strategy are set.
+ ***********************************************************************/
+static void estimatePlan(const PlanInput *input, Plan *plan)
+{
+    double solveTime;
+    size_t solveMemory;
+    estimateSolver(input, plan, &solveTime, &solveMemory);
+
+    size_t rounds = (input->channels + plan->threads - 1) / plan->threads;
+    double samples = (double)input->pixels * input->channels;
+    size_t outputSize = input->indexOutput ? 1 : input->bytesPerSample;
+
+    plan->estimatedTime = rounds * solveTime + samples * NS_PER_SAMPLE * 1e-9;
+    plan->estimatedMemory = plan->threads * solveMemory
+                          + (plan->inPlace ? 0 : (size_t)samples * outputSize);
+}
+
+static size_t availableCores(const PlannerConstraints *constraints)
+{
+    if(constraints->cores > 0)
+        return constraints->cores;
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores > 0 ? (size_t)cores : 1;
+}
+
+int planCompression(const PlanInput *input,
+                    const PlannerConstraints *constraints, Plan *plan)
+{
+    if(!input || !constraints || !plan)
+        return -1;
+
+    size_t cores = availableCores(constraints);
+    size_t maxThreads = input->channels < cores ? input->channels : cores;
+    if(maxThreads == 0)
+        maxThreads = 1;
+
+    bool found = false, fallback = false;
+    Plan best = {0}, leanest = {0};
+
+    for(Solver solver=SOLVER_EQUAL_POPULATION; solver<=SOLVER_EXACT; solver++)
+    {
+        if(solverOptimality[solver] < constraints->optimality)
+            continue;
+        // Without coarsening, coarse-to-fine is the exact solver
+        if(solver == SOLVER_COARSE_TO_FINE && coarseFactor(input) <= 1)
+            continue;
+
+        for(size_t threads=maxThreads; threads>0; threads--)
+        {
+            Plan candidate = {solver, 0, 0, threads, false, 0, 0,
+                              {NORM_L2, NULL, 0}};
+            candidate.coarseLength = COARSE_LENGTH;
+            candidate.window = input->length / COARSE_LENGTH;
+            candidate.inPlace = constraints->allowInPlace
+                                && !input->indexOutput;
+            candidate.metric = constraints->metric;
+            estimatePlan(input, &candidate);
+
+            if(!fallback
+               || candidate.estimatedMemory < leanest.estimatedMemory)
+            {
+                leanest = candidate;
+                fallback = true;
+            }
+
+            bool fits = constraints->memoryLimit == 0
+                || candidate.estimatedMemory <= constraints->memoryLimit;
+            if(fits && (!found || candidate.estimatedTime < best.estimatedTime))
+            {
+                best = candidate;
+                found = true;
+            }
+        }
+    }
+
+    *plan = found ? best : leanest;
+    return found ? 0 : -1;
+}
+
+
+
+Mapping* computeMappingWithPlan(const Histogram *histogram, size_t nLevels,
+                                const void *context)
+{
+    const Plan *plan = context;
+    if(!plan)
+        return NULL;
+
+    // 8-bit exact solves do not need the prefix sums, up to
+    // EXACT8_MAX_PIXELS pixels (then solved with long double sums)
+    if(plan->solver == SOLVER_EXACT && histogram
+       && histogram->length == EXACT8_LENGTH && nLevels <= EXACT8_MAX_LEVELS
+       && plan->metric.norm == NORM_L2 && !plan->metric.weights)
+    {
+        Mapping *mapping = computeMappingExact8(histogram, nLevels);
+        if(mapping)
+            return mapping;
+    }
+
+    CumulativeHistogram *cumulative =
+        createMetricCumulativeHistogram(histogram, &plan->metric);
+    if(!cumulative)
+        return NULL;
+
+    Mapping *mapping = NULL;
+    switch(plan->solver)
+    {
+        case SOLVER_EQUAL_POPULATION:
+            mapping = equalPopulationMapping(cumulative, nLevels, NULL);
+            break;
+        case SOLVER_COARSE_TO_FINE:
+            mapping = coarseToFineMapping(cumulative, nLevels,
+                                          plan->coarseLength, plan->window,
+                                          NULL);
+            break;
+        case SOLVER_EXACT:
+            mapping = nLevels <= FEW_LEVELS_MAX
+                ? fewLevelsMapping(cumulative, nLevels, NULL)
+                : exactMapping(cumulative, nLevels, NULL);
+            break;
+    }
+
+    freeCumulativeHistogram(cumulative);
+    return mapping;
+}
+
+
+
+void logPlan(FILE *stream, const PlanInput *input, const Plan *plan)
+{
+    if(!stream || !input || !plan)
+        return;
+
+    fprintf(stream, "Plan: solver=%s", solverNames[plan->solver]);
+    if(plan->solver == SOLVER_COARSE_TO_FINE)
+        fprintf(stream, "(coarse=%zu, window=%zu)", plan->coarseLength,
+                plan->window);
+    if(plan->metric.norm == NORM_L1 || plan->metric.weights)
+        fprintf(stream, " metric=%s%s",
+                plan->metric.weights ? "weighted-" : "",
+                plan->metric.norm == NORM_L1 ? "L1" : "L2");
+    fprintf(stream, " threads=%zu output=%s time~%.3gs memory~%zuB"
+                    " [n=%zu d=%zu k=%zu pixels=%zu channels=%zu]\n",
+            plan->threads,
+            input->indexOutput ? "index" : plan->inPlace ? "in-place" : "copy",
+            plan->estimatedTime, plan->estimatedMemory, input->length,
+            input->distinct, input->nLevels, input->pixels, input->channels);
+}
@@ -0,0 +1,140 @@
+/***********************************************************************
+ * Cost-model planner: chooses how to compress an image.
+ *
+ * For each mapping solver, the planner estimates the time and the memory
+ * of the whole compression (solve and remap) from the histogram length,
+ * the number of distinct values, k, the size of the image and the number
+ * of cores. It then picks the fastest plan whose solver is at least as
+ * optimal as requested and whose memory fits in the given cap.
+ ***********************************************************************/
+
+#ifndef _PLANNER_H_
+#define _PLANNER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "Mapping.h"
+
+/* Available solvers, from the fastest to the most accurate */
+typedef enum
+{
+    SOLVER_EQUAL_POPULATION,    // computeMappingEqualPopulation
+    SOLVER_COARSE_TO_FINE,      // computeMappingCoarseToFine
+    SOLVER_EXACT                // computeMappingExact (computeMappingFewLevels
+                                // for 2 or 3 levels)
+
+} Solver;
+
+/* Minimum quality required from the solver */
+typedef enum
+{
+    OPTIMALITY_APPROXIMATE,     // Any solver
+    OPTIMALITY_NEAR_OPTIMAL,    // Coarse-to-fine or exact
+    OPTIMALITY_EXACT            // Exact only
+
+} Optimality;
+
+/* What is known about the compression before solving */
+typedef struct
+{
+    size_t length;              // Histogram length (n)
+    size_t distinct;            // Largest number of non-empty bins (d)
+    size_t nLevels;             // Number of levels (k)
+    size_t pixels;              // Number of pixels of the image
+    size_t channels;            // Number of histograms to solve
+    size_t bytesPerSample;      // Sample size of the image
+    bool indexOutput;           // One byte per sample output
+
+} PlanInput;
+
+/* What the caller allows */
+typedef struct
+{
+    Optimality optimality;      // Minimum quality of the solver
+    size_t memoryLimit;         // In bytes, 0 for no limit
+    size_t cores;               // Available cores, 0 to detect them
+    bool allowInPlace;          // The input raster may be overwritten
+    ErrorMetric metric;         // Error minimized by the mappings
+
+} PlannerConstraints;
+
+typedef struct
+{
+    Solver solver;
+    size_t coarseLength;        // SOLVER_COARSE_TO_FINE parameters
+    size_t window;
+    size_t threads;             // Histograms solved concurrently
+    bool inPlace;               // Overwrite the input raster
+    double estimatedTime;       // In seconds
+    size_t estimatedMemory;     // Additional memory, in bytes
+    ErrorMetric metric;         // Error minimized by the mappings
+
+} Plan;
+
+
+/***********************************************************************
+ * Describe a compression from its histograms.
+ *
+ * PARAMETERS
+ * hists          An array of `channels` valid pointers to Histogram
+ * channels       The number of histograms
+ * nLevels        The number of levels
+ * pixels         The number of pixels of the image
+ * bytesPerSample The sample size of the image
+ * indexOutput    Whether the output is an index image
+ *
+ * RETURN
+ * input          The description of the compression
+ ***********************************************************************/
+PlanInput planInput(Histogram *const *hists, size_t channels, size_t nLevels,
+                    size_t pixels, size_t bytesPerSample, bool indexOutput);
+
+
+/***********************************************************************
+ * Choose the fastest plan satisfying the constraints.
+ *
+ * PARAMETERS
+ * input        A valid pointer to the description of the compression
+ * constraints  A valid pointer to the constraints
+ * plan         Receives the chosen plan
+ *
+ * RETURN
+ * 0            If a plan satisfies the constraints
+ * non-0        Otherwise (`plan` then holds the plan using the least
+ *              memory among the sufficiently optimal ones)
+ ***********************************************************************/
+int planCompression(const PlanInput *input,
+                    const PlannerConstraints *constraints, Plan *plan);
+
+
+/***********************************************************************
+ * Compute a mapping with the solver of a plan. Its signature makes it
+ * usable as a MappingSolver (see quantizer.h) with the plan as context.
+ *
+ * PARAMETERS
+ * histogram    A valid pointer to an Histogram
+ * nLevels      The number of levels
+ * plan         A valid pointer to a Plan
+ *
+ * RETURN
+ * mapping     A pointer to a Mapping. It must be deleted by calling
+ *             `freeMapping`
+ * NULL        In case of error
+ ***********************************************************************/
+Mapping* computeMappingWithPlan(const Histogram *histogram, size_t nLevels,
+                                const void *plan);
+
+
+/***********************************************************************
+ * Log a plan and the description it was chosen from, on one line.
+ *
+ * PARAMETERS
+ * stream       The output stream
+ * input        A valid pointer to the description of the compression
+ * plan         A valid pointer to the plan
+ ***********************************************************************/
+void logPlan(FILE *stream, const PlanInput *input, const Plan *plan);
+
+#endif // !_PLANNER_H_
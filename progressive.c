@@ -0,0 +1,150 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "progressive.h"
+
+// Maximum depth of a stream (indices on one byte)
+#define MAX_DEPTH 8
+
+/* Sample s of the raster of an image */
+static inline uint16_t rasterSample(const PGM *image, size_t s)
+{
+    return image->bytesPerSample == 1 ? ((const uint8_t*)image->raster)[s]
+                                      : ((const uint16_t*)image->raster)[s];
+}
+
+/* Write 16-bit values, most significant byte first */
+static int writeLevels(FILE *file, const uint16_t *levels, size_t count)
+{
+    for(size_t i=0; i<count; i++)
+        if(fputc(levels[i] >> 8, file) == EOF
+           || fputc(levels[i] & 0xFF, file) == EOF)
+            return -1;
+    return 0;
+}
+
+int writeProgressive(FILE *file, const PGM *image, Mapping *const *mappings,
+                     size_t depth)
+{
+    if(!file || !image || !mappings || depth == 0 || depth > MAX_DEPTH
+       || image->channels > 3)
+        return -1;
+
+    size_t channels = image->channels;
+    size_t samples = image->width * image->height * channels;
+    size_t planeBytes = (samples + 7) / 8;
+
+    // Index of each value at the last level, per channel
+    uint8_t *indexTables[3] = {NULL};
+    uint8_t *plane = malloc(planeBytes > 0 ? planeBytes : 1);
+    int status = plane ? 0 : -1;
+    for(size_t c=0; c<channels && status == 0; c++)
+    {
+        indexTables[c] = malloc((size_t)image->maxValue+1);
+        status = !indexTables[c]
+                 || mappings[(depth-1) * channels + c]->nLevels
+                    != ((size_t)1 << depth)
+                 || mapping2IndexBuffer(mappings[(depth-1) * channels + c],
+                                        image->maxValue,
+                                        indexTables[c]) != 0;
+    }
+
+    if(status == 0)
+        status = fprintf(file, "PQ\n%zu %zu\n%zu %u %zu\n", image->width,
+                         image->height, channels, image->maxValue,
+                         depth) < 0;
+
+    for(size_t j=1; j<=depth && status == 0; j++)
+    {
+        for(size_t c=0; c<channels && status == 0; c++)
+            status = writeLevels(file, mappings[(j-1) * channels + c]->levels,
+                                 (size_t)1 << j);
+
+        // Bit depth-j of the index of every sample
+        unsigned shift = (unsigned)(depth - j);
+        memset(plane, 0, planeBytes);
+        for(size_t s=0; s<samples; s++)
+        {
+            uint8_t bit = (indexTables[s % channels][rasterSample(image, s)]
+                           >> shift) & 1;
+            plane[s / 8] |= (uint8_t)(bit << (7 - s % 8));
+        }
+        if(status == 0 && fwrite(plane, 1, planeBytes, file) != planeBytes)
+            status = -1;
+    }
+
+    for(size_t c=0; c<channels; c++)
+        free(indexTables[c]);
+    free(plane);
+    return status;
+}
+
+PGM* readProgressive(FILE *file, size_t planes, size_t *decoded)
+{
+    char magic[3];
+    size_t width = 0, height = 0, channels = 0, depth = 0;
+    unsigned maxValue = 0;
+    if(!file || fscanf(file, "%2s", magic) != 1 || strcmp(magic, "PQ") != 0
+       || fscanf(file, "%zu %zu %zu %u %zu", &width, &height, &channels,
+                 &maxValue, &depth) != 5
+       || (channels != 1 && channels != 3) || maxValue > UINT16_MAX
+       || depth == 0 || depth > MAX_DEPTH)
+        return NULL;
+    fgetc(file); // Single white space before the binary data
+
+    if(planes == 0 || planes > depth)
+        planes = depth;
+
+    size_t samples = width * height * channels;
+    size_t planeBytes = (samples + 7) / 8;
+    uint8_t *indices = calloc(samples > 0 ? samples : 1, 1);
+    uint8_t *plane = malloc(planeBytes > 0 ? planeBytes : 1);
+    uint16_t levels[3][1 << MAX_DEPTH], next[3][1 << MAX_DEPTH];
+    size_t read = 0;
+    bool complete = indices && plane;
+    for(size_t j=1; j<=planes && complete; j++)
+    {
+        for(size_t c=0; c<channels && complete; c++)
+            for(size_t i=0; i<((size_t)1 << j) && complete; i++)
+            {
+                int high = fgetc(file), low = fgetc(file);
+                complete = high != EOF && low != EOF;
+                next[c][i] = (uint16_t)((high << 8) | low);
+            }
+        complete = complete && fread(plane, 1, planeBytes, file)
+                               == planeBytes;
+        if(!complete)
+            break;
+
+        for(size_t s=0; s<samples; s++)
+            indices[s] = (uint8_t)((indices[s] << 1)
+                                   | ((plane[s / 8] >> (7 - s % 8)) & 1));
+        memcpy(levels, next, sizeof(levels));
+        read = j;
+    }
+
+    // The levels of the last complete plane
+    PGM *image = read > 0
+        ? createEmptyMultiChannelImage(width, height, channels, maxValue)
+        : NULL;
+    if(image)
+    {
+        image->type = channels == 1 ? BINARY : PPM_BINARY;
+        for(size_t s=0; s<samples; s++)
+        {
+            uint16_t value = levels[s % channels][indices[s]];
+            if(image->bytesPerSample == 1)
+                ((uint8_t*)image->raster)[s] = (uint8_t)value;
+            else
+                ((uint16_t*)image->raster)[s] = value;
+        }
+    }
+
+    free(indices);
+    free(plane);
+    if(image && decoded)
+        *decoded = read;
+    return image;
+}
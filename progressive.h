@@ -0,0 +1,65 @@
+/***********************************************************************
+ * Progressive (embedded) encoding of an image quantized with nested
+ * mappings (see `computeNestedMappings`): the k = 2^depth levels are sent
+ * as `depth` bit planes, the plane j holding bit depth-j of the index of
+ * every sample. After the plane j, a viewer holds the index of each
+ * sample at level j, i.e. the image on 2^j levels; the whole stream is
+ * about the size of the indices at the last level.
+ *
+ * Stream format (binary, after a text header in the style of PGM):
+ *   "PQ\n<width> <height>\n<channels> <maxValue> <depth>\n"
+ *   then, for each level j = 1..depth:
+ *     the 2^j levels of each channel (16-bit, most significant byte
+ *     first),
+ *     the plane j: one bit per sample in raster order (channels
+ *     interleaved), most significant bit first, padded to a byte.
+ ***********************************************************************/
+
+#ifndef _PROGRESSIVE_H_
+#define _PROGRESSIVE_H_
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "PGM.h"
+#include "Mapping.h"
+
+
+/***********************************************************************
+ * Write the progressive stream of an image.
+ *
+ * PARAMETERS
+ * file         A file opened for writing
+ * image        A valid pointer to the (original) image
+ * mappings     The `depth x image->channels` nested mappings: entry
+ *              (j-1) * channels + c is the mapping of channel c on 2^j
+ *              levels
+ * depth        The number of levels of the hierarchy (1 to 8)
+ *
+ * RETURN
+ * 0            If no error
+ * non-0        Otherwise
+ ***********************************************************************/
+int writeProgressive(FILE *file, const PGM *image, Mapping *const *mappings,
+                     size_t depth);
+
+
+/***********************************************************************
+ * Decode the first planes of a progressive stream. A stream cut after a
+ * complete plane (e.g. a partial download) is decoded up to that plane.
+ * The image must later be deleted by calling freeImage().
+ *
+ * PARAMETERS
+ * file         A file opened for reading, positioned on the stream
+ * planes       The number of planes to decode (0 or more than the depth
+ *              of the stream: all of them)
+ * decoded      If not NULL, receives the number of planes decoded (the
+ *              image has 2^decoded levels per channel)
+ *
+ * RETURN
+ * NULL         if any error (no complete plane)
+ * image        The image (binary PGM/PPM)
+ ***********************************************************************/
+PGM* readProgressive(FILE *file, size_t planes, size_t *decoded);
+
+#endif // !_PROGRESSIVE_H_
@@ -0,0 +1,236 @@
+/***********************************************************************
+ * Nested mappings for progressive transmission.
+ *
+ * Level j of the hierarchy has 2^j intervals, obtained by splitting each
+ * interval of level j-1 in two: its boundaries are a superset of those of
+ * the previous level, so the index of a value at level j is its index at
+ * the last level shifted right, and each level adds one bit per pixel.
+ *
+ * The hierarchy is a binary tree of splits. With F_t(a, b) the smallest
+ * error of the t levels refining the interval [a, b):
+ *   F_0(a, b) = 0
+ *   F_t(a, b) = min_s E(a, s) + E(s, b) + F_{t-1}(a, s) + F_{t-1}(s, b)
+ * and F_depth(0, d) is the smallest sum of the errors of all the levels
+ * (every preview counts). It is solved in O(depth d^3) on the d non-empty
+ * bins, with the interval errors E tabulated. Longer histograms (16-bit
+ * images) split each interval optimally in two, level by level, in
+ * O(depth d): the hierarchy is then approximate, which is reported to the
+ * caller.
+ ***********************************************************************/
+#include <stdlib.h>
+#include <float.h>
+
+#include "compression.h"
+
+// Longest (compact) histogram solved exactly
+#define MAX_EXACT_NESTED_LENGTH 512
+
+/***********************************************************************
+ * Best split s of [a, b) in two intervals of at least `margin` bins
+ * each, for the error of the two intervals only.
+ ***********************************************************************/
+static size_t bestSplit(const CumulativeHistogram *cumulative, size_t a,
+                        size_t b, size_t margin)
+{
+    size_t best = a + margin;
+    double bestError = DBL_MAX;
+    for(size_t s=a+margin; s+margin<=b; s++)
+    {
+        double error = intervalError(cumulative, a, s, NULL)
+                     + intervalError(cumulative, s, b, NULL);
+        if(error < bestError)
+        {
+            bestError = error;
+            best = s;
+        }
+    }
+    return best;
+}
+
+/***********************************************************************
+ * Solve the recurrence of the hierarchy on `depth` levels. Entry
+ * ((t-1) w + a) w + b of `splits` (w = length + 1) receives the best
+ * split of [a, b) refined by t levels, for the intervals of the
+ * hierarchy.
+ *
+ * RETURN
+ * 0            If no error
+ * non-0        Otherwise (out of memory)
+ ***********************************************************************/
+static int solveNested(const CumulativeHistogram *cumulative, size_t depth,
+                       uint16_t *splits)
+{
+    size_t d = cumulative->length, w = d + 1;
+    double *errors = malloc(w * w * sizeof(double));
+    double *previous = calloc(w * w, sizeof(double));
+    double *current = malloc(w * w * sizeof(double));
+    if(!errors || !previous || !current)
+    {
+        free(errors);
+        free(previous);
+        free(current);
+        return -1;
+    }
+
+    for(size_t a=0; a<d; a++)
+        for(size_t b=a+1; b<=d; b++)
+            errors[a*w + b] = intervalError(cumulative, a, b, NULL);
+
+    for(size_t t=1; t<=depth; t++)
+    {
+        size_t margin = (size_t)1 << (t-1);
+        uint16_t *split = splits + (t-1) * w * w;
+
+        // Only the whole histogram is refined by `depth` levels
+        size_t lastA = t == depth ? 0 : d - 2 * margin;
+        for(size_t a=0; a<=lastA; a++)
+            for(size_t b=t == depth ? d : a + 2*margin; b<=d; b++)
+            {
+                double best = DBL_MAX;
+                size_t bestS = a + margin;
+                for(size_t s=a+margin; s+margin<=b; s++)
+                {
+                    double error = errors[a*w + s] + errors[s*w + b]
+                                 + previous[a*w + s] + previous[s*w + b];
+                    if(error < best)
+                    {
+                        best = error;
+                        bestS = s;
+                    }
+                }
+                current[a*w + b] = best;
+                split[a*w + b] = (uint16_t)bestS;
+            }
+
+        double *swap = previous;
+        previous = current;
+        current = swap;
+    }
+
+    free(errors);
+    free(previous);
+    free(current);
+    return 0;
+}
+
+/***********************************************************************
+ * Build the mappings of the hierarchy from the root down, each interval
+ * being split with `splits` (or `bestSplit` if NULL).
+ ***********************************************************************/
+static int buildNested(const CumulativeHistogram *cumulative, size_t depth,
+                       const uint16_t *splits, Mapping **mappings)
+{
+    size_t d = cumulative->length, w = d + 1;
+    size_t *bounds = malloc((((size_t)1 << depth) + 1) * sizeof(size_t));
+    size_t *next = malloc((((size_t)1 << depth) + 1) * sizeof(size_t));
+    int status = bounds && next ? 0 : -1;
+
+    // Level 0: [0, d)
+    size_t intervals = 1;
+    if(status == 0)
+    {
+        bounds[0] = 0;
+        bounds[1] = d;
+    }
+
+    for(size_t j=1; j<=depth && status == 0; j++)
+    {
+        size_t t = depth - j + 1;
+        for(size_t i=0; i<intervals; i++)
+        {
+            size_t a = bounds[i], b = bounds[i+1];
+            next[2*i] = a;
+            next[2*i+1] = splits ? splits[((t-1) * w + a) * w + b]
+                                 : bestSplit(cumulative, a, b,
+                                             (size_t)1 << (t-1));
+        }
+        intervals *= 2;
+        next[intervals] = d;
+
+        size_t *swap = bounds;
+        bounds = next;
+        next = swap;
+
+        mappings[j-1] = createMappingFromBoundaries(cumulative, bounds + 1,
+                                                    intervals, intervals);
+        status = mappings[j-1] ? 0 : -1;
+    }
+
+    free(bounds);
+    free(next);
+    return status;
+}
+
+size_t nestedMappings(const CumulativeHistogram *cumulative, size_t depth,
+                      Mapping **mappings, bool *optimal)
+{
+    if(!cumulative || !mappings || depth == 0 || depth > MAX_NESTED_DEPTH)
+        return 0;
+    for(size_t j=0; j<depth; j++)
+        mappings[j] = NULL;
+
+    size_t n = cumulative->length, distinct = 0;
+    for(size_t i=0; i<n; i++)
+        distinct += cumulative->count[i+1] != cumulative->count[i];
+    if(distinct == 0)
+        return 0;
+
+    // Every interval of the last level holds a non-empty bin
+    while(((size_t)1 << depth) > distinct)
+        depth--;
+    if(depth == 0)
+        return 0;
+
+    bool compacted = distinct < n && !cumulative->values;
+    CumulativeHistogram *compact = compacted
+        ? createCompactCumulative(cumulative, distinct, NULL) : NULL;
+    const CumulativeHistogram *solved = compacted ? compact : cumulative;
+    if(!solved)
+        return 0;
+
+    size_t d = solved->length, w = d + 1;
+    uint16_t *splits = NULL;
+    int status = 0;
+    bool exact = d <= MAX_EXACT_NESTED_LENGTH;
+    if(exact)
+    {
+        splits = malloc(depth * w * w * sizeof(uint16_t));
+        status = !splits || solveNested(solved, depth, splits) != 0;
+    }
+    if(status == 0)
+        status = buildNested(solved, depth, splits, mappings);
+    free(splits);
+
+    // Back from compact indices to gray values
+    for(size_t j=0; j<depth && status == 0 && compacted; j++)
+        for(size_t i=0; i<mappings[j]->nLevels; i++)
+            mappings[j]->thresholds[i] =
+                mappings[j]->thresholds[i] < distinct
+                ? compact->values[mappings[j]->thresholds[i]] : n;
+
+    freeCumulativeHistogramInArena(NULL, compact);
+    if(status != 0)
+    {
+        for(size_t j=0; j<depth; j++)
+        {
+            freeMapping(mappings[j]);
+            mappings[j] = NULL;
+        }
+        return 0;
+    }
+    if(optimal)
+        *optimal = exact;
+    return depth;
+}
+
+size_t computeNestedMappings(const Histogram *histogram, size_t depth,
+                             Mapping **mappings, bool *optimal)
+{
+    CumulativeHistogram *cumulative = createCumulativeHistogram(histogram);
+    if(!cumulative)
+        return 0;
+
+    size_t solved = nestedMappings(cumulative, depth, mappings, optimal);
+    freeCumulativeHistogram(cumulative);
+    return solved;
+}
@@ -0,0 +1,74 @@
+/***********************************************************************
+ * Equal-population mapping: each level represents (about) the same
+ * number of pixels. The thresholds are the k-quantiles of the histogram,
+ * found by binary search on the cumulative counts, and each level is the
+ * rounded centroid of its interval, read from the prefix sums.
+ * Costs O(n) for the prefix sums and O(k log n) for the mapping; all
+ * counts are 64-bit.
+ ***********************************************************************/
+#include <stdlib.h>
+
+#include "compression.h"
+
+/***********************************************************************
+ * Smallest p in [lo, hi] with count[p] >= target (hi if none).
+ ***********************************************************************/
+static size_t lowerBound(const unsigned long long *count, size_t lo,
+                         size_t hi, unsigned long long target)
+{
+    while(lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if(count[mid] < target)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+Mapping* equalPopulationMapping(const CumulativeHistogram *cumulative,
+                                size_t nLevels, Arena *arena)
+{
+    if(!cumulative || cumulative->length == 0 || nLevels == 0)
+        return NULL;
+
+    size_t n = cumulative->length;
+    size_t k = nLevels < n ? nLevels : n;
+    unsigned long long total = cumulative->count[n];
+
+    size_t *boundaries = arenaAlloc(arena, k * sizeof(size_t));
+    if(!boundaries)
+        return NULL;
+
+    // p_i: first value whose cumulative count reaches i/k of the pixels,
+    // kept strictly increasing and leaving room for the next levels
+    size_t previous = 0;
+    for(size_t i=1; i<k; i++)
+    {
+        // ceil(i * total / k) without overflowing
+        unsigned long long target = total / k * i
+                                  + (total % k * i + k - 1) / k;
+        previous = lowerBound(cumulative->count, previous + 1, n - k + i,
+                              target);
+        boundaries[i-1] = previous;
+    }
+
+    Mapping *mapping = createMappingFromBoundariesInArena(arena, cumulative,
+                                                          boundaries, k,
+                                                          nLevels);
+    arenaFree(arena, boundaries);
+    return mapping;
+}
+
+Mapping* computeMappingEqualPopulation(const Histogram *histogram,
+                                       size_t nLevels)
+{
+    CumulativeHistogram *cumulative = createCumulativeHistogram(histogram);
+    if(!cumulative)
+        return NULL;
+
+    Mapping *mapping = equalPopulationMapping(cumulative, nLevels, NULL);
+    freeCumulativeHistogram(cumulative);
+    return mapping;
+}
@@ -0,0 +1,554 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "quantizer.h"
+#include "compression.h"
+#include "planner.h"
+
+/***********************************************************************
+ * Number of bytes used to store one sample of the given buffer, 0 if the
+ * buffer is invalid.
+ ***********************************************************************/
+static size_t sampleSize(const PixelBuffer *buffer)
+{
+    if(!buffer || buffer->bitDepth == 0 || buffer->bitDepth > 16
+       || buffer->channels == 0)
+        return 0;
+
+    size_t size = buffer->bitDepth <= 8 ? sizeof(uint8_t) : sizeof(uint16_t);
+    if(buffer->height > 0 &&
+       (!buffer->pixels
+        || buffer->stride < buffer->width * buffer->channels * size))
+        return 0;
+
+    return size;
+}
+
+static inline const void* rowOf(const PixelBuffer *buffer, size_t i)
+{
+    return (const unsigned char*)buffer->pixels + i * buffer->stride;
+}
+
+
+
+/* Count one row; channel c of the interleaved samples goes to hists[c] */
+#define DEFINE_HISTOGRAM_ROW(NAME, SRC_T)                                    \
+static int NAME(const SRC_T *in, size_t rowLength, size_t channels,          \
+                Histogram *const *hists)                                     \
+{                                                                            \
+    for(size_t j=0, c=0; j<rowLength; j++)                                   \
+    {                                                                        \
+        if(in[j] >= hists[c]->length)                                        \
+            return -1;                                                       \
+        hists[c]->count[in[j]]++;                                            \
+        if(++c == channels)                                                  \
+            c = 0;                                                           \
+    }                                                                        \
+    return 0;                                                                \
+}
+
+DEFINE_HISTOGRAM_ROW(histogramRow8, uint8_t)
+DEFINE_HISTOGRAM_ROW(histogramRow16, uint16_t)
+
+/***********************************************************************
+ * 8-bit single channel fast path (requires `hist->length >= 256`, so that
+ * no bound check is needed). Four partial histograms are used so that
+ * runs of equal pixels do not serialize on the same counter.
+ ***********************************************************************/
+static void histogram8(const PixelBuffer *src, Histogram *hist)
+{
+    unsigned long long partial[4][UINT8_MAX+1];
+    memset(partial, 0, sizeof(partial));
+
+    for(size_t i=0; i<src->height; i++)
+    {
+        const uint8_t *in = rowOf(src, i);
+        size_t j = 0;
+        for(; j+4<=src->width; j+=4)
+        {
+            partial[0][in[j]]++;
+            partial[1][in[j+1]]++;
+            partial[2][in[j+2]]++;
+            partial[3][in[j+3]]++;
+        }
+        for(; j<src->width; j++)
+            partial[0][in[j]]++;
+    }
+
+    for(size_t v=0; v<=UINT8_MAX; v++)
+        hist->count[v] = partial[0][v] + partial[1][v]
+                       + partial[2][v] + partial[3][v];
+}
+
+int quantizerHistogram(const PixelBuffer *src, Histogram *const *hists)
+{
+    size_t size = sampleSize(src);
+    if(size == 0 || !hists)
+        return -1;
+
+    for(size_t c=0; c<src->channels; c++)
+    {
+        if(!hists[c] || !hists[c]->count)
+            return -1;
+        memset(hists[c]->count, 0,
+               hists[c]->length * sizeof(unsigned long long));
+    }
+
+    if(size == sizeof(uint8_t) && src->channels == 1
+       && hists[0]->length > UINT8_MAX)
+    {
+        histogram8(src, hists[0]);
+        return 0;
+    }
+
+    size_t rowLength = src->width * src->channels;
+    for(size_t i=0; i<src->height; i++)
+    {
+        int status = size == sizeof(uint8_t)
+            ? histogramRow8(rowOf(src, i), rowLength, src->channels, hists)
+            : histogramRow16(rowOf(src, i), rowLength, src->channels, hists);
+        if(status != 0)
+            return status;
+    }
+
+    return 0;
+}
+
+
+
+/***********************************************************************
+ * Compute the mapping with `solver` and copy it in the arrays of
+ * `mapping`.
+ ***********************************************************************/
+static int solveInto(const Histogram *hist, Mapping *mapping,
+                     MappingSolver solver, const void *context)
+{
+    if(!hist || !mapping || !mapping->thresholds || !mapping->levels
+       || mapping->nLevels == 0)
+        return -1;
+
+    Mapping *computed = solver(hist, mapping->nLevels, context);
+    if(!computed)
+        return -1;
+
+    memcpy(mapping->thresholds, computed->thresholds,
+           mapping->nLevels * sizeof(size_t));
+    memcpy(mapping->levels, computed->levels,
+           mapping->nLevels * sizeof(uint16_t));
+
+    freeMapping(computed);
+    return 0;
+}
+
+/*
+ * Default MappingSolver: the solver chosen by the planner for the
+ * histogram, with the default constraints of the compressor (near-optimal
+ * L2 mapping, no memory limit)
+ */
+static Mapping* defaultSolver(const Histogram *histogram, size_t nLevels,
+                              const void *context)
+{
+    (void)context;
+    if(!histogram)
+        return NULL;
+
+    PlannerConstraints constraints = {OPTIMALITY_NEAR_OPTIMAL, 0, 1, false,
+                                      {NORM_L2, NULL, 0}};
+    Histogram *hists[] = {(Histogram*)histogram};
+    PlanInput input = planInput(hists, 1, nLevels, 0,
+                                histogram->length > UINT8_MAX + 1 ? 2 : 1,
+                                false);
+    Plan plan;
+    planCompression(&input, &constraints, &plan); // No limit: always fits
+    return computeMappingWithPlan(histogram, nLevels, &plan);
+}
+
+int quantizerMapping(const Histogram *hist, Mapping *mapping)
+{
+    return solveInto(hist, mapping, defaultSolver, NULL);
+}
+
+
+
+typedef struct
+{
+    Histogram *const *hists;
+    Mapping *const *mappings;
+    size_t count;
+    size_t first;           // This job solves first, first+stride, ...
+    size_t stride;
+    MappingSolver solver;
+    const void *context;
+    int status;
+
+} MappingJob;
+
+static void* mappingWorker(void *arg)
+{
+    MappingJob *job = arg;
+    job->status = 0;
+    for(size_t c=job->first; c<job->count; c+=job->stride)
+        if(solveInto(job->hists[c], job->mappings[c], job->solver,
+                     job->context) != 0)
+            job->status = -1;
+    return NULL;
+}
+
+int quantizerSolveMappings(Histogram *const *hists, Mapping *const *mappings,
+                           size_t count, MappingSolver solver,
+                           const void *context, size_t maxThreads)
+{
+    if(!hists || !mappings || !solver)
+        return -1;
+
+    size_t numThreads = maxThreads < count ? maxThreads : count;
+    if(numThreads == 0)
+        numThreads = 1;
+
+    MappingJob *jobs = malloc(numThreads * sizeof(MappingJob));
+    pthread_t *threads = malloc(numThreads * sizeof(pthread_t));
+    int *started = calloc(numThreads, sizeof(int));
+    if(!jobs || !threads || !started)
+    {
+        free(jobs);
+        free(threads);
+        free(started);
+        return -1;
+    }
+
+    // Spawn the extra threads, the first job runs here
+    for(size_t t=0; t<numThreads; t++)
+    {
+        jobs[t] = (MappingJob){hists, mappings, count, t, numThreads,
+                               solver, context, -1};
+        if(t > 0)
+            started[t] = pthread_create(&threads[t], NULL, mappingWorker,
+                                        &jobs[t]) == 0;
+    }
+
+    int status = 0;
+    for(size_t t=0; t<numThreads; t++)
+    {
+        if(started[t])
+            pthread_join(threads[t], NULL);
+        else
+            mappingWorker(&jobs[t]); // Inline fallback
+        if(jobs[t].status != 0)
+            status = jobs[t].status;
+    }
+
+    free(jobs);
+    free(threads);
+    free(started);
+    return status;
+}
+
+int quantizerMappings(Histogram *const *hists, Mapping *const *mappings,
+                      size_t count)
+{
+    return quantizerSolveMappings(hists, mappings, count, defaultSolver, NULL,
+                                  count);
+}
+
+
+
+/* Remap one row; generated for every (source, destination) sample type */
+#define DEFINE_REMAP_ROW(NAME, SRC_T, DST_T, DST_MAX)                        \
+static int NAME(const SRC_T *in, DST_T *out, size_t rowLength,               \
+                size_t channels, const uint16_t *const *lookUpTables,        \
+                size_t length, double *err)                                  \
+{                                                                            \
+    double delta, sum = 0;                                                   \
+    for(size_t j=0, c=0; j<rowLength; j++)                                   \
+    {                                                                        \
+        SRC_T old = in[j];                                                   \
+        if(old >= length || lookUpTables[c][old] > (DST_MAX))                \
+            return -1;                                                       \
+        uint16_t new = lookUpTables[c][old];                                 \
+        delta = (double)old - (double)new;                                   \
+        sum += delta * delta;                                                \
+        out[j] = (DST_T)new;                                                 \
+        if(++c == channels)                                                  \
+            c = 0;                                                           \
+    }                                                                        \
+    *err += sum;                                                             \
+    return 0;                                                                \
+}
+
+DEFINE_REMAP_ROW(remapRow8to8, uint8_t, uint8_t, UINT8_MAX)
+DEFINE_REMAP_ROW(remapRow8to16, uint8_t, uint16_t, UINT16_MAX)
+DEFINE_REMAP_ROW(remapRow16to8, uint16_t, uint8_t, UINT8_MAX)
+DEFINE_REMAP_ROW(remapRow16to16, uint16_t, uint16_t, UINT16_MAX)
+
+/***********************************************************************
+ * Narrow a lookup table to bytes and tabulate the squared error of each
+ * 8-bit value. Returns non-0 if a level does not fit on a byte.
+ ***********************************************************************/
+static int narrowLookup(const uint16_t *lookUpTable, uint8_t *narrow,
+                        unsigned long long *squared)
+{
+    for(size_t v=0; v<=UINT8_MAX; v++)
+    {
+        if(lookUpTable[v] > UINT8_MAX)
+            return -1;
+        long long delta = (long long)v - lookUpTable[v];
+        narrow[v] = (uint8_t)lookUpTable[v];
+        squared[v] = (unsigned long long)(delta * delta);
+    }
+    return 0;
+}
+
+/***********************************************************************
+ * 8-bit to 8-bit single channel fast path. The lookup table is narrowed
+ * to bytes and the squared error of each value is tabulated, so the
+ * inner loop is two byte-indexed loads per pixel. Returns non-0 (and
+ * does nothing) when the fast path does not apply.
+ ***********************************************************************/
+static int remap8(const PixelBuffer *src, PixelBuffer *dst,
+                  const uint16_t *lookUpTable, size_t length, double *err)
+{
+    uint8_t narrow[UINT8_MAX+1];
+    unsigned long long squared[UINT8_MAX+1];
+    if(length <= UINT8_MAX || narrowLookup(lookUpTable, narrow, squared) != 0)
+        return -1;
+
+    unsigned long long sum = 0;
+    for(size_t i=0; i<src->height; i++)
+    {
+        const uint8_t *in = rowOf(src, i);
+        uint8_t *out = (uint8_t*)dst->pixels + i * dst->stride;
+        for(size_t j=0; j<src->width; j++)
+        {
+            uint8_t old = in[j];
+            sum += squared[old];
+            out[j] = narrow[old];
+        }
+    }
+
+    *err = (double)sum;
+    return 0;
+}
+
+int quantizerRemap(const PixelBuffer *src, PixelBuffer *dst,
+                   const uint16_t *const *lookUpTables, size_t length,
+                   double *error)
+{
+    size_t srcSize = sampleSize(src);
+    size_t dstSize = sampleSize(dst);
+    if(srcSize == 0 || dstSize == 0 || !lookUpTables
+       || src->width != dst->width || src->height != dst->height
+       || src->channels != dst->channels)
+        return -1;
+
+    double err = 0;
+    if(srcSize == sizeof(uint8_t) && dstSize == sizeof(uint8_t)
+       && src->channels == 1
+       && remap8(src, dst, lookUpTables[0], length, &err) == 0)
+    {
+        if(error)
+            *error = err;
+        return 0;
+    }
+
+    int status = 0;
+    size_t rowLength = src->width * src->channels, n = src->channels;
+    for(size_t i=0; i<src->height && status == 0; i++)
+    {
+        const void *in = rowOf(src, i);
+        void *out = (unsigned char*)dst->pixels + i * dst->stride;
+
+        if(srcSize == sizeof(uint8_t))
+            status = dstSize == sizeof(uint8_t)
+                ? remapRow8to8(in, out, rowLength, n, lookUpTables, length, &err)
+                : remapRow8to16(in, out, rowLength, n, lookUpTables, length, &err);
+        else
+            status = dstSize == sizeof(uint8_t)
+                ? remapRow16to8(in, out, rowLength, n, lookUpTables, length, &err)
+                : remapRow16to16(in, out, rowLength, n, lookUpTables, length, &err);
+    }
+
+    if(error)
+        *error = err;
+    return status;
+}
+
+
+
+
+/***********************************************************************
+ * 8-bit to 8-bit single channel fast path of `quantizerRemapMany`: each
+ * source row is read once and remapped into every output while it is in
+ * cache. Returns non-0 (and does nothing) when it does not apply.
+ ***********************************************************************/
+static int remapMany8(const PixelBuffer *src, PixelBuffer *const *dsts,
+                      const uint16_t *const *const *lookUpTables,
+                      size_t outputs, size_t length, double *errors)
+{
+    if(length <= UINT8_MAX)
+        return -1;
+
+    uint8_t (*narrow)[UINT8_MAX+1] = malloc(outputs * sizeof(*narrow));
+    unsigned long long (*squared)[UINT8_MAX+1] =
+        malloc(outputs * sizeof(*squared));
+    unsigned long long *sums = calloc(outputs, sizeof(unsigned long long));
+    int status = narrow && squared && sums ? 0 : -1;
+    for(size_t o=0; o<outputs && status == 0; o++)
+        status = narrowLookup(lookUpTables[o][0], narrow[o], squared[o]);
+
+    for(size_t i=0; i<src->height && status == 0; i++)
+    {
+        const uint8_t *in = rowOf(src, i);
+        for(size_t o=0; o<outputs; o++)
+        {
+            uint8_t *out = (uint8_t*)dsts[o]->pixels + i * dsts[o]->stride;
+            const uint8_t *table = narrow[o];
+            const unsigned long long *squares = squared[o];
+            unsigned long long sum = 0;
+            for(size_t j=0; j<src->width; j++)
+            {
+                uint8_t old = in[j];
+                sum += squares[old];
+                out[j] = table[old];
+            }
+            sums[o] += sum;
+        }
+    }
+
+    if(status == 0)
+        for(size_t o=0; o<outputs; o++)
+            errors[o] = (double)sums[o];
+
+    free(narrow);
+    free(squared);
+    free(sums);
+    return status;
+}
+
+int quantizerRemapMany(const PixelBuffer *src, PixelBuffer *const *dsts,
+                       const uint16_t *const *const *lookUpTables,
+                       size_t outputs, size_t length, double *errors)
+{
+    size_t srcSize = sampleSize(src);
+    if(srcSize == 0 || !dsts || !lookUpTables || outputs == 0)
+        return -1;
+
+    int all8 = srcSize == sizeof(uint8_t) && src->channels == 1;
+    for(size_t o=0; o<outputs; o++)
+    {
+        size_t dstSize = sampleSize(dsts[o]);
+        if(dstSize == 0 || !lookUpTables[o]
+           || dsts[o]->width != src->width || dsts[o]->height != src->height
+           || dsts[o]->channels != src->channels
+           || (src->height > 0 && dsts[o]->pixels == src->pixels))
+            return -1;
+        all8 = all8 && dstSize == sizeof(uint8_t);
+    }
+
+    double *err = calloc(outputs, sizeof(double));
+    if(!err)
+        return -1;
+
+    int status = 0;
+    if(!all8 || remapMany8(src, dsts, lookUpTables, outputs, length,
+                           err) != 0)
+    {
+        memset(err, 0, outputs * sizeof(double));
+        size_t rowLength = src->width * src->channels, n = src->channels;
+        for(size_t i=0; i<src->height && status == 0; i++)
+        {
+            const void *in = rowOf(src, i);
+            for(size_t o=0; o<outputs && status == 0; o++)
+            {
+                void *out = (unsigned char*)dsts[o]->pixels
+                          + i * dsts[o]->stride;
+                const uint16_t *const *tables = lookUpTables[o];
+                int dst8 = dsts[o]->bitDepth <= 8;
+
+                if(srcSize == sizeof(uint8_t))
+                    status = dst8
+                        ? remapRow8to8(in, out, rowLength, n, tables, length,
+                                       &err[o])
+                        : remapRow8to16(in, out, rowLength, n, tables, length,
+                                        &err[o]);
+                else
+                    status = dst8
+                        ? remapRow16to8(in, out, rowLength, n, tables, length,
+                                        &err[o])
+                        : remapRow16to16(in, out, rowLength, n, tables, length,
+                                         &err[o]);
+            }
+        }
+    }
+
+    if(errors && status == 0)
+        memcpy(errors, err, outputs * sizeof(double));
+    free(err);
+    return status;
+}
+
+
+/* Index one row; generated for both source sample types */
+#define DEFINE_INDEX_ROW(NAME, SRC_T)                                        \
+static int NAME(const SRC_T *in, uint8_t *out, size_t rowLength,             \
+                size_t channels, const uint8_t *const *indexTables,          \
+                Mapping *const *palettes, size_t length, double *err)        \
+{                                                                            \
+    double delta, sum = 0;                                                   \
+    for(size_t j=0, c=0; j<rowLength; j++)                                   \
+    {                                                                        \
+        SRC_T old = in[j];                                                   \
+        if(old >= length)                                                    \
+            return -1;                                                       \
+        uint8_t index = indexTables[c][old];                                 \
+        if(err)                                                              \
+        {                                                                    \
+            delta = (double)old - (double)palettes[c]->levels[index];        \
+            sum += delta * delta;                                            \
+        }                                                                    \
+        out[j] = index;                                                      \
+        if(++c == channels)                                                  \
+            c = 0;                                                           \
+    }                                                                        \
+    if(err)                                                                  \
+        *err += sum;                                                         \
+    return 0;                                                                \
+}
+
+DEFINE_INDEX_ROW(indexRow8, uint8_t)
+DEFINE_INDEX_ROW(indexRow16, uint16_t)
+
+int quantizerIndex(const PixelBuffer *src, PixelBuffer *dst,
+                   const uint8_t *const *indexTables,
+                   Mapping *const *palettes, size_t length, double *error)
+{
+    size_t srcSize = sampleSize(src);
+    if(srcSize == 0 || sampleSize(dst) != sizeof(uint8_t) || !indexTables
+       || (error && !palettes)
+       || src->width != dst->width || src->height != dst->height
+       || src->channels != dst->channels)
+        return -1;
+
+    // In place is only possible when the samples have the same size
+    if(src->pixels == dst->pixels && srcSize != sizeof(uint8_t))
+        return -1;
+
+    double err = 0;
+    int status = 0;
+    size_t rowLength = src->width * src->channels, n = src->channels;
+    for(size_t i=0; i<src->height && status == 0; i++)
+    {
+        const void *in = rowOf(src, i);
+        uint8_t *out = (uint8_t*)dst->pixels + i * dst->stride;
+
+        status = srcSize == sizeof(uint8_t)
+            ? indexRow8(in, out, rowLength, n, indexTables, palettes, length,
+                        error ? &err : NULL)
+            : indexRow16(in, out, rowLength, n, indexTables, palettes, length,
+                         error ? &err : NULL);
+    }
+
+    if(error)
+        *error = err;
+    return status;
+}
@@ -0,0 +1,199 @@
+/***********************************************************************
+ * libquantizer: in-memory quantization API.
+ *
+ * Works directly on pixel buffers owned by the caller (no file I/O, no
+ * copy of the raster). A typical use is:
+ *   1. `quantizerHistogram` to fill the histogram of the buffer,
+ *   2. `quantizerMapping` to compute the mapping in caller arrays,
+ *   3. `quantizerRemap` to write the quantized pixels in a destination
+ *      buffer (which may be the source buffer itself, for an in-place
+ *      quantization), `quantizerRemapMany` to write several quantized
+ *      versions in a single pass, or `quantizerIndex` to only write the
+ *      level indices on one byte per pixel.
+ *
+ * Multi-channel (interleaved) buffers are quantized channel by channel:
+ * one histogram, one mapping and one lookup table per channel. The
+ * histograms are built in a single pass over the buffer, the mappings
+ * can be solved concurrently with `quantizerMappings` and the remap is a
+ * single pass as well.
+ *
+ * The Histogram and Mapping structures of "Mapping.h" are used as plain
+ * views: their arrays may point to memory owned by the caller and they
+ * must then NOT be released with `freeHistogram` / `freeMapping`.
+ ***********************************************************************/
+
+#ifndef _QUANTIZER_H_
+#define _QUANTIZER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Mapping.h"
+
+/* Strided view on a caller-owned raster */
+typedef struct
+{
+    void *pixels;       // First pixel of the first row
+    size_t width;       // Number of pixels per row
+    size_t channels;    // Interleaved samples per pixel (1: gray, 3: RGB)
+    size_t height;      // Number of rows
+    size_t stride;      // Number of bytes between two consecutive rows
+    unsigned bitDepth;  // 1..8: uint8_t samples, 9..16: uint16_t samples
+
+} PixelBuffer;
+
+
+/***********************************************************************
+ * Compute the histogram of each channel of a pixel buffer.
+ *
+ * PARAMETERS
+ * src          A valid pointer to a PixelBuffer
+ * hists        An array of `src->channels` Histograms, each `count` array
+ *              holding `length` entries. The counts are overwritten.
+ *
+ * RETURN
+ * 0            If no error
+ * non-0        Otherwise (invalid buffer or pixel value >= length)
+ ***********************************************************************/
+int quantizerHistogram(const PixelBuffer *src, Histogram *const *hists);
+
+
+/***********************************************************************
+ * Compute the mapping of a histogram on `mapping->nLevels` levels, with
+ * the solver the planner chooses by default (see planner.h), and store it
+ * in the arrays of `mapping`.
+ *
+ * PARAMETERS
+ * hist         A valid pointer to a Histogram
+ * mapping      A Mapping whose `thresholds` and `levels` arrays hold at
+ *              least `nLevels` entries
+ *
+ * RETURN
+ * 0            If no error
+ * non-0        Otherwise
+ ***********************************************************************/
+int quantizerMapping(const Histogram *hist, Mapping *mapping);
+
+
+/* A mapping solver (see compression.h), with an optional context */
+typedef Mapping* (*MappingSolver)(const Histogram *histogram, size_t nLevels,
+                                  const void *context);
+
+
+/***********************************************************************
+ * Compute the mappings of several histograms with the given solver, on
+ * up to `maxThreads` threads, and store them in the arrays of `mappings`
+ * (see `quantizerMapping`).
+ *
+ * PARAMETERS
+ * hists        An array of `count` Histograms
+ * mappings     An array of `count` Mappings
+ * count        The number of histograms
+ * solver       The solver
+ * context      Passed to each call of `solver`
+ * maxThreads   Maximum number of threads (including the calling one)
+ *
+ * RETURN
+ * 0            If no error
+ * non-0        Otherwise
+ ***********************************************************************/
+int quantizerSolveMappings(Histogram *const *hists, Mapping *const *mappings,
+                           size_t count, MappingSolver solver,
+                           const void *context, size_t maxThreads);
+
+
+/***********************************************************************
+ * Same as `quantizerMapping` for several histograms at once (typically
+ * one per channel); the mappings are computed concurrently, one thread
+ * per histogram.
+ *
+ * PARAMETERS
+ * hists        An array of `count` Histograms
+ * mappings     An array of `count` Mappings (see `quantizerMapping`)
+ * count        The number of histograms
+ *
+ * RETURN
+ * 0            If no error
+ * non-0        Otherwise
+ ***********************************************************************/
+int quantizerMappings(Histogram *const *hists, Mapping *const *mappings,
+                      size_t count);
+
+
+/***********************************************************************
+ * Apply one lookup table per channel to a pixel buffer.
+ *
+ * PARAMETERS
+ * src          A valid pointer to the source PixelBuffer
+ * dst          A valid pointer to the destination PixelBuffer. It must
+ *              have the same dimensions as `src`; it may be `src` itself
+ * lookUpTables An array of `src->channels` lookup tables (see
+ *              `mapping2LookupBuffer`)
+ * length       Number of entries of each lookup table
+ * error        If not NULL, receives the squared error of the remap
+ *
+ * RETURN
+ * 0            If no error
+ * non-0        Otherwise (invalid buffers or pixel value >= length)
+ ***********************************************************************/
+int quantizerRemap(const PixelBuffer *src, PixelBuffer *dst,
+                   const uint16_t *const *lookUpTables, size_t length,
+                   double *error);
+
+
+
+/***********************************************************************
+ * Fan-out remap: apply several sets of lookup tables (typically the
+ * mappings of the same histogram on different numbers of levels) to a
+ * pixel buffer, writing one destination per set. The source is walked
+ * once: each row is remapped into every destination while it is in
+ * cache.
+ *
+ * PARAMETERS
+ * src          A valid pointer to the source PixelBuffer
+ * dsts         An array of `outputs` valid pointers to the destination
+ *              PixelBuffers, with the dimensions of `src`. None of them
+ *              may be `src` itself
+ * lookUpTables An array of `outputs` arrays of `src->channels` lookup
+ *              tables: lookUpTables[o][c] is used for channel c of dsts[o]
+ * outputs      The number of destinations
+ * length       Number of entries of each lookup table
+ * errors       If not NULL, an array of `outputs` entries receiving the
+ *              squared error of each remap
+ *
+ * RETURN
+ * 0            If no error
+ * non-0        Otherwise (invalid buffers or pixel value >= length)
+ ***********************************************************************/
+int quantizerRemapMany(const PixelBuffer *src, PixelBuffer *const *dsts,
+                       const uint16_t *const *const *lookUpTables,
+                       size_t outputs, size_t length, double *errors);
+
+
+
+/***********************************************************************
+ * Write, for each sample, the index of its level instead of the level
+ * itself: a compact one byte per sample image whose palette is the
+ * `levels` array of the mapping of its channel.
+ *
+ * PARAMETERS
+ * src          A valid pointer to the source PixelBuffer
+ * dst          A valid pointer to the destination PixelBuffer, with 8-bit
+ *              samples and the same dimensions as `src`. It may be `src`
+ *              itself when `src` has 8-bit samples
+ * indexTables  An array of `src->channels` index tables (see
+ *              `mapping2IndexBuffer`)
+ * palettes     An array of `src->channels` Mappings, only used (and then
+ *              required) if `error` is not NULL
+ * length       Number of entries of each index table
+ * error        If not NULL, receives the squared error of the quantization
+ *
+ * RETURN
+ * 0            If no error
+ * non-0        Otherwise (invalid buffers or pixel value >= length)
+ ***********************************************************************/
+int quantizerIndex(const PixelBuffer *src, PixelBuffer *dst,
+                   const uint8_t *const *indexTables,
+                   Mapping *const *palettes, size_t length, double *error);
+
+#endif // !_QUANTIZER_H_
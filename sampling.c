@@ -0,0 +1,229 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "sampling.h"
+#include "PGM.h"
+
+/* xorshift64: column phases of SAMPLING_RANDOM */
+static inline unsigned long long nextRandom(unsigned long long *state)
+{
+    unsigned long long x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+/* Column of the first kept pixel of the next kept row */
+static inline size_t nextPhase(const Sampling *sampling,
+                               unsigned long long *state)
+{
+    if(sampling->mode == SAMPLING_RANDOM)
+        return (size_t)(nextRandom(state) % sampling->colStep);
+    return sampling->colStep / 2;
+}
+
+static inline unsigned long long initialState(const Sampling *sampling)
+{
+    // xorshift must not start from 0
+    return sampling->seed * 2654435761ULL + 0x9E3779B97F4A7C15ULL;
+}
+
+
+
+Sampling samplingFromRate(double rate, SamplingMode mode)
+{
+    Sampling sampling = {mode, 1, 1, 0};
+    if(!(rate > 0) || rate >= 1)
+        return sampling;
+
+    double step = 1. / rate;
+    sampling.rowStep = (size_t)ceil(sqrt(step));
+    sampling.colStep = (size_t)floor(step / sampling.rowStep + 0.5);
+    if(sampling.colStep == 0)
+        sampling.colStep = 1;
+
+    return sampling;
+}
+
+
+
+double samplingRateForConfidence(size_t numPixels, double maxQuantileError,
+                                 double confidence)
+{
+    if(numPixels == 0 || !(maxQuantileError > 0) || !(confidence > 0)
+       || confidence >= 1)
+        return 1.;
+
+    double needed = log(2. / (1. - confidence))
+                  / (2. * maxQuantileError * maxQuantileError);
+    double rate = needed / (double)numPixels;
+    return rate < 1. ? rate : 1.;
+}
+
+
+
+/* Count the kept samples of one row; generated for both sample sizes */
+#define DEFINE_SAMPLED_ROW(NAME, SRC_T)                                      \
+static int NAME(const SRC_T *in, size_t width, size_t channels,              \
+                size_t phase, size_t colStep, Histogram *const *hists)       \
+{                                                                            \
+    for(size_t j=phase; j<width; j+=colStep)                                 \
+        for(size_t c=0; c<channels; c++)                                     \
+        {                                                                    \
+            SRC_T value = in[j*channels + c];                                \
+            if(value >= hists[c]->length)                                    \
+                return -1;                                                   \
+            hists[c]->count[value]++;                                        \
+        }                                                                    \
+    return 0;                                                                \
+}
+
+DEFINE_SAMPLED_ROW(sampledRow8, uint8_t)
+DEFINE_SAMPLED_ROW(sampledRow16, uint16_t)
+
+int sampledHistogram(const PixelBuffer *src, Histogram *const *hists,
+                     Sampling sampling)
+{
+    if(!src || !hists || sampling.rowStep == 0 || sampling.colStep == 0
+       || src->bitDepth == 0 || src->bitDepth > 16 || src->channels == 0
+       || (src->height > 0 && !src->pixels))
+        return -1;
+
+    for(size_t c=0; c<src->channels; c++)
+    {
+        if(!hists[c] || !hists[c]->count)
+            return -1;
+        memset(hists[c]->count, 0,
+               hists[c]->length * sizeof(unsigned long long));
+    }
+
+    unsigned long long state = initialState(&sampling);
+    for(size_t i=sampling.rowStep/2; i<src->height; i+=sampling.rowStep)
+    {
+        const void *row = (const unsigned char*)src->pixels + i * src->stride;
+        size_t phase = nextPhase(&sampling, &state);
+        int status = src->bitDepth <= 8
+            ? sampledRow8(row, src->width, src->channels, phase,
+                          sampling.colStep, hists)
+            : sampledRow16(row, src->width, src->channels, phase,
+                           sampling.colStep, hists);
+        if(status != 0)
+            return status;
+    }
+
+    return 0;
+}
+
+
+
+/* Sampled histogram of an ascii raster: every value has to be parsed */
+static int sampledHistogramAscii(FILE *file, const PGMHeader *header,
+                                 Histogram *hist, Sampling sampling)
+{
+    unsigned long long state = initialState(&sampling);
+    size_t rowStart = sampling.rowStep / 2, phase = 0;
+
+    for(size_t i=0; i<header->height; i++)
+    {
+        int kept = i >= rowStart && (i - rowStart) % sampling.rowStep == 0;
+        if(kept)
+            phase = nextPhase(&sampling, &state);
+
+        for(size_t j=0; j<header->width; j++)
+        {
+            int value = -1;
+            if(fscanf(file, "%d", &value) != 1 || value < 0
+               || (size_t)value >= hist->length)
+                return -1;
+            if(kept && j >= phase && (j - phase) % sampling.colStep == 0)
+                hist->count[value]++;
+        }
+    }
+
+    return 0;
+}
+
+/* Sampled histogram of a binary raster: unsampled rows are skipped */
+static int sampledHistogramBinary(FILE *file, const PGMHeader *header,
+                                  Histogram *hist, Sampling sampling)
+{
+    size_t rowBytes = header->width * header->bytesPerSample;
+    unsigned char *bytes = malloc(rowBytes > 0 ? rowBytes : 1);
+    uint16_t *row = malloc((header->width > 0 ? header->width : 1)
+                           * sizeof(uint16_t));
+    if(!bytes || !row)
+    {
+        free(bytes);
+        free(row);
+        return -1;
+    }
+
+    unsigned long long state = initialState(&sampling);
+    int status = 0;
+
+    for(size_t i=sampling.rowStep/2; i<header->height && status == 0;
+        i+=sampling.rowStep)
+    {
+        long offset = header->rasterOffset + (long)(i * rowBytes);
+        if(fseek(file, offset, SEEK_SET) != 0
+           || fread(bytes, 1, rowBytes, file) != rowBytes)
+        {
+            status = -1;
+            break;
+        }
+
+        // Decode (16-bit samples are stored most significant byte first)
+        for(size_t j=0; j<header->width; j++)
+            row[j] = header->bytesPerSample == 1
+                   ? bytes[j]
+                   : (uint16_t)((bytes[2*j] << 8) | bytes[2*j+1]);
+
+        size_t phase = nextPhase(&sampling, &state);
+        status = sampledRow16(row, header->width, 1, phase,
+                              sampling.colStep, &hist);
+    }
+
+    free(bytes);
+    free(row);
+    return status;
+}
+
+Histogram* sampledHistogramFromFile(const char *filename, Sampling sampling)
+{
+    if(!filename || sampling.rowStep == 0 || sampling.colStep == 0)
+        return NULL;
+
+    FILE *file = fopen(filename, "r");
+    if(!file)
+        return NULL;
+
+    PGMHeader header;
+    if(readImageHeader(file, &header) != 0 || header.channels != 1)
+    {
+        fclose(file);
+        return NULL;
+    }
+
+    Histogram *hist = createEmptyHistogram((size_t)header.maxValue + 1);
+    if(!hist)
+    {
+        fclose(file);
+        return NULL;
+    }
+
+    int status = header.type == BINARY
+        ? sampledHistogramBinary(file, &header, hist, sampling)
+        : sampledHistogramAscii(file, &header, hist, sampling);
+
+    fclose(file);
+    if(status != 0)
+    {
+        freeHistogram(hist);
+        return NULL;
+    }
+
+    return hist;
+}
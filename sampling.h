@@ -0,0 +1,105 @@
+/***********************************************************************
+ * Approximate histograms built from a subsample of the pixels.
+ *
+ * The thresholds of a mapping only depend on the shape of the histogram,
+ * which a subsample estimates well on large images. The sample keeps one
+ * row every `rowStep` rows and, in each kept row, one pixel every
+ * `colStep` pixels. With SAMPLING_RANDOM, the column phase of each kept
+ * row is drawn at random (jittered stride) to avoid aliasing with
+ * periodic content.
+ *
+ * The counts of a sampled histogram are NOT rescaled: they sum to the
+ * number of sampled pixels.
+ ***********************************************************************/
+
+#ifndef _SAMPLING_H_
+#define _SAMPLING_H_
+
+#include <stddef.h>
+
+#include "Mapping.h"
+#include "quantizer.h"
+
+typedef enum
+{
+    SAMPLING_STRIDED,
+    SAMPLING_RANDOM
+
+} SamplingMode;
+
+typedef struct
+{
+    SamplingMode mode;
+    size_t rowStep;         // One row kept every `rowStep` rows
+    size_t colStep;         // One pixel kept every `colStep` pixels
+    unsigned long seed;     // Seed of the column phases (SAMPLING_RANDOM)
+
+} Sampling;
+
+
+/***********************************************************************
+ * Build a sampling keeping approximately a fraction `rate` of the pixels.
+ * The steps are split between rows and columns so that whole rows can
+ * be skipped.
+ *
+ * PARAMETERS
+ * rate         The fraction of pixels to keep, in ]0, 1]
+ * mode         The sampling mode
+ *
+ * RETURN
+ * sampling     The sampling (every pixel is kept if `rate` is invalid)
+ ***********************************************************************/
+Sampling samplingFromRate(double rate, SamplingMode mode);
+
+
+/***********************************************************************
+ * Smallest sample rate such that, with probability at least
+ * `confidence`, every quantile of the sampled histogram is within
+ * `maxQuantileError` of the full one (Dvoretzky-Kiefer-Wolfowitz bound:
+ * ln(2 / (1 - confidence)) / (2 maxQuantileError^2) samples).
+ *
+ * PARAMETERS
+ * numPixels        Number of pixels of the image
+ * maxQuantileError Tolerated error on the cumulative distribution, in ]0, 1[
+ * confidence       Target confidence, in ]0, 1[
+ *
+ * RETURN
+ * rate             The sample rate, in ]0, 1]
+ ***********************************************************************/
+double samplingRateForConfidence(size_t numPixels, double maxQuantileError,
+                                 double confidence);
+
+
+/***********************************************************************
+ * Same as `quantizerHistogram` but only counts the sampled pixels.
+ *
+ * PARAMETERS
+ * src          A valid pointer to a PixelBuffer
+ * hists        An array of `src->channels` Histograms (overwritten)
+ * sampling     The sampling
+ *
+ * RETURN
+ * 0            If no error
+ * non-0        Otherwise
+ ***********************************************************************/
+int sampledHistogram(const PixelBuffer *src, Histogram *const *hists,
+                     Sampling sampling);
+
+
+/***********************************************************************
+ * Compute the sampled histogram of a grayscale image file without
+ * loading it. For binary (P5) images the rows that are not sampled are
+ * skipped in the file, so only about 1/rowStep of the raster is read.
+ *
+ * PARAMETERS
+ * filename     File name of a pgm image
+ * sampling     The sampling
+ *
+ * RETURN
+ * histo       A pointer to a Histogram of length maxValue+1. It must be
+ *             deleted by calling `freeHistogram`
+ * NULL        In case of error
+ ***********************************************************************/
+Histogram* sampledHistogramFromFile(const char *filename, Sampling sampling);
+
+#endif // !_SAMPLING_H_
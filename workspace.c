@@ -0,0 +1,146 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <float.h>
+
+#include "workspace.h"
+#include "compression.h"
+
+/***********************************************************************
+ * Upper bound of the arena memory of a solve on a histogram of length n
+ * with k levels, 0 if it overflows. The worst case is the exact solver
+ * on a compacted histogram: two cumulative histograms (the full one and
+ * the compact one), the candidate sets and boundaries, the dynamic
+ * programming tables (at most k n entries) and the mapping.
+ ***********************************************************************/
+static size_t workspaceBytes(size_t n, size_t k)
+{
+    if(n >= SIZE_MAX / (4 * sizeof(long double)) || k == 0
+       || n * 2 * sizeof(double) > SIZE_MAX / k / 2)
+        return 0;
+
+    size_t cumulative = arenaSize(sizeof(CumulativeHistogram))
+                      + arenaSize((n+1) * sizeof(unsigned long long))
+                      + 3 * arenaSize((n+1) * sizeof(long double));
+    size_t values = arenaSize(n * sizeof(size_t));
+    size_t candidates = arenaSize(k * 3 * sizeof(size_t))
+                      + 2 * arenaSize(k * sizeof(size_t));
+    size_t tables = 2 * arenaSize((k * n > 0 ? k * n : 1) * sizeof(double));
+    size_t mapping = arenaSize(sizeof(Mapping))
+                   + arenaSize(k * sizeof(size_t))
+                   + arenaSize(k * sizeof(uint16_t));
+
+    return 2 * cumulative + values + candidates + tables + mapping;
+}
+
+SolverWorkspace* createSolverWorkspace(size_t length, size_t nLevels)
+{
+    size_t bytes = workspaceBytes(length, nLevels);
+    if(length == 0 || bytes == 0)
+        return NULL;
+
+    SolverWorkspace *workspace = malloc(sizeof(SolverWorkspace));
+    Arena *arena = createArena(bytes);
+    uint16_t *lookUpTable = malloc(length * sizeof(uint16_t));
+    if(!workspace || !arena || !lookUpTable)
+    {
+        free(workspace);
+        freeArena(arena);
+        free(lookUpTable);
+        return NULL;
+    }
+
+    workspace->length = length;
+    workspace->nLevels = nLevels;
+    workspace->arena = arena;
+    workspace->mapping = NULL;
+    workspace->solvedLength = 0;
+    workspace->metric = (ErrorMetric){NORM_L2, NULL, 0};
+    workspace->lookUpTable = lookUpTable;
+    workspace->lookUpValid = false;
+
+    return workspace;
+}
+
+
+
+void freeSolverWorkspace(SolverWorkspace *workspace)
+{
+    if(!workspace) return;
+    freeArena(workspace->arena);
+    free(workspace->lookUpTable);
+    free(workspace);
+}
+
+
+
+const Mapping* workspaceSolve(SolverWorkspace *workspace,
+                              const Histogram *histogram, size_t nLevels,
+                              const Plan *plan)
+{
+    if(!workspace || !histogram || !plan || histogram->length == 0
+       || histogram->length > workspace->length || nLevels == 0
+       || nLevels > workspace->nLevels)
+        return NULL;
+
+    // Everything of the previous solve goes at once
+    Arena *arena = workspace->arena;
+    arena->used = 0;
+    workspace->mapping = NULL;
+    workspace->lookUpValid = false;
+
+    CumulativeHistogram *cumulative =
+        createCumulativeHistogramInArena(arena, histogram, &plan->metric);
+    if(!cumulative)
+        return NULL;
+
+    Mapping *mapping = NULL;
+    switch(plan->solver)
+    {
+        case SOLVER_EQUAL_POPULATION:
+            mapping = equalPopulationMapping(cumulative, nLevels, arena);
+            break;
+        case SOLVER_COARSE_TO_FINE:
+            mapping = coarseToFineMapping(cumulative, nLevels,
+                                          plan->coarseLength, plan->window,
+                                          arena);
+            break;
+        case SOLVER_EXACT:
+            mapping = nLevels <= FEW_LEVELS_MAX
+                ? fewLevelsMapping(cumulative, nLevels, arena)
+                : exactMapping(cumulative, nLevels, arena);
+            break;
+    }
+
+    workspace->mapping = mapping;
+    workspace->solvedLength = histogram->length;
+    workspace->metric = plan->metric;
+    return mapping;
+}
+
+
+
+const uint16_t* workspaceLookup(SolverWorkspace *workspace)
+{
+    if(!workspace || !workspace->mapping)
+        return NULL;
+
+    if(!workspace->lookUpValid)
+        workspace->lookUpValid =
+            mapping2LookupBuffer(workspace->mapping,
+                                 (uint16_t)(workspace->solvedLength - 1),
+                                 workspace->lookUpTable) == 0;
+
+    return workspace->lookUpValid ? workspace->lookUpTable : NULL;
+}
+
+
+
+double workspaceError(SolverWorkspace *workspace, const Histogram *histogram)
+{
+    if(!workspace || !histogram
+       || histogram->length != workspace->solvedLength)
+        return DBL_MAX;
+
+    return lookupError(workspaceLookup(workspace), histogram,
+                       &workspace->metric);
+}
@@ -0,0 +1,115 @@
+/***********************************************************************
+ * Solver workspace: the memory of a mapping solve, allocated once and
+ * reused from call to call.
+ *
+ * A workspace is sized for histograms of at most `length` values and
+ * mappings of at most `nLevels` levels. Every solve takes its prefix
+ * sums, dynamic programming tables and resulting Mapping from the arena
+ * of the workspace, which is reset at the next solve; the lookup table of
+ * the last mapping is computed once and cached. Solving, then querying
+ * the lookup table or the error, therefore allocates nothing.
+ *
+ * A workspace may be moved from thread to thread between calls, but
+ * must not be used by two threads at once (use one per thread).
+ ***********************************************************************/
+
+#ifndef _WORKSPACE_H_
+#define _WORKSPACE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Mapping.h"
+#include "planner.h"
+
+typedef struct
+{
+    size_t length;              // Maximum histogram length (n)
+    size_t nLevels;             // Maximum number of levels (k)
+    Arena *arena;               // Memory of the solves
+    const Mapping *mapping;     // Last mapping (in `arena`), NULL if none
+    size_t solvedLength;        // Length of the histogram of `mapping`
+    ErrorMetric metric;         // Metric `mapping` was computed for
+    uint16_t *lookUpTable;      // Lookup table of `mapping` (n entries)
+    bool lookUpValid;           // Whether `lookUpTable` is up to date
+
+} SolverWorkspace;
+
+
+/***********************************************************************
+ * Create a workspace able to run any solver of the planner. Its memory
+ * is O(k n), the worst case of the exact solver.
+ *
+ * PARAMETERS
+ * length       The maximum length of the histograms (n)
+ * nLevels      The maximum number of levels (k)
+ *
+ * RETURN
+ * workspace    A pointer to a SolverWorkspace. It must be deleted by
+ *              calling `freeSolverWorkspace`
+ * NULL         In case of error
+ ***********************************************************************/
+SolverWorkspace* createSolverWorkspace(size_t length, size_t nLevels);
+
+
+/***********************************************************************
+ * Free the memory allocated by this workspace (including its mapping)
+ *
+ * PAREMETERS
+ * workspace    A pointer to a SolverWorkspace
+ ***********************************************************************/
+void freeSolverWorkspace(SolverWorkspace *workspace);
+
+
+/***********************************************************************
+ * Compute a mapping with the solver and the metric of a plan (see
+ * `computeMappingWithPlan`), in the memory of the workspace.
+ *
+ * PARAMETERS
+ * workspace    A valid pointer to a SolverWorkspace
+ * histogram    A valid pointer to an Histogram of at most
+ *              `workspace->length` values
+ * nLevels      The number of levels, at most `workspace->nLevels`
+ * plan         A valid pointer to a Plan
+ *
+ * RETURN
+ * mapping      The mapping. It belongs to the workspace and is valid
+ *              until its next solve: it must NOT be deleted
+ * NULL         In case of error
+ ***********************************************************************/
+const Mapping* workspaceSolve(SolverWorkspace *workspace,
+                              const Histogram *histogram, size_t nLevels,
+                              const Plan *plan);
+
+
+/***********************************************************************
+ * Lookup table of the last mapping (see `mapping2Lookup`), computed at
+ * the first call after the solve.
+ *
+ * PARAMETERS
+ * workspace    A valid pointer to a SolverWorkspace
+ *
+ * RETURN
+ * lookUpTable  The lookup table, with one entry per value of the solved
+ *              histogram. It belongs to the workspace and is valid until
+ *              its next solve
+ * NULL         In case of error (no mapping)
+ ***********************************************************************/
+const uint16_t* workspaceLookup(SolverWorkspace *workspace);
+
+
+/***********************************************************************
+ * Error of the last mapping on a histogram of the same length as the
+ * solved one, for the metric of the solve (see `computeMetricError`).
+ *
+ * PARAMETERS
+ * workspace    A valid pointer to a SolverWorkspace
+ * histogram    A valid pointer to an Histogram
+ *
+ * RETURN
+ * error        The error or DBL_MAX in case of error
+ ***********************************************************************/
+double workspaceError(SolverWorkspace *workspace, const Histogram *histogram);
+
+#endif // !_WORKSPACE_H_